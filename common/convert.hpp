@@ -1,54 +1,495 @@
 #pragma once
 
+#include <google/protobuf/descriptor.h>
 #include <google/protobuf/message.h>
+#include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/util/json_util.h>
 #include <jsoncpp/json/json.h>
 #include <jsoncpp/json/reader.h>
 #include <jsoncpp/json/value.h>
 #include <jsoncpp/json/writer.h>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
 #include <memory>
-#include <sstream>
+#include <string>
+#include <string_view>
 
 namespace Common {
+/* pb和json之间的转换
+ * json串和pb之间的转换直接使用protobuf的接口，输出选项只构造一次
+ * Json::Value和pb之间通过反射直接转换，不经过json串中转，google.protobuf包中的类型（Any、Struct、Timestamp等）
+ * 有特殊的json格式，这部分仍然经过json串转换
+ */
 class Convert
 {
 public:
+  // jsonStr会先被清空再写入，调用方复用同一个string时可以复用它的内存
   static bool Pb2JsonStr( const google::protobuf::Message& message, std::string& jsonStr, bool addWhitespace = false )
+  {
+    jsonStr.clear();
+    return google::protobuf::util::MessageToJsonString( message, &jsonStr, printOptions( addWhitespace ) ).ok();
+  }
+
+  // 直接解析调用方的内存，例如接收缓冲区中的body，不需要先拷贝成std::string
+  static bool JsonStr2Pb( std::string_view jsonStr, google::protobuf::Message& message )
+  {
+    google::protobuf::StringPiece input( jsonStr.data(), jsonStr.size() );
+    return google::protobuf::util::JsonStringToMessage( input, &message ).ok();
+  }
+
+  /* 输出和Pb2JsonStr的结果解析成Json::Value一致，64位整数为字符串，enum为整数，字段名为proto中的名字
+   * 唯一的区别是浮点数都是real类型，json串解析得到的整数值浮点数是int类型
+   */
+  static bool Pb2Json( const google::protobuf::Message& message, Json::Value& value )
+  {
+    const google::protobuf::Descriptor* descriptor = message.GetDescriptor();
+    if ( isWellKnownType( descriptor ) ) {
+      return wellKnown2Json( message, value );
+    }
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    value = Json::Value( Json::objectValue );
+    for ( int i = 0; i < descriptor->field_count(); ++i ) {
+      const google::protobuf::FieldDescriptor* field = descriptor->field( i );
+      // 没有设置的message和oneof字段（包括proto3的optional）不输出，其它字段即使没有设置也输出默认值
+      bool mayOmit = google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE == field->cpp_type()
+                     || field->containing_oneof() != nullptr;
+      if ( !field->is_repeated() && mayOmit && !reflection->HasField( message, field ) ) {
+        continue;
+      }
+      if ( !field2Json( message, field, value[field->name()] ) ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 和JsonStr2Pb一致，message会先被清空，字段名可以是proto中的名字或者驼峰名字，存在未知字段时返回false
+  static bool Json2Pb( const Json::Value& value, google::protobuf::Message& message )
+  {
+    message.Clear();
+    return json2Message( value, message );
+  }
+
+private:
+  static const google::protobuf::util::JsonPrintOptions& printOptions( bool addWhitespace )
+  {
+    static const google::protobuf::util::JsonPrintOptions options = makePrintOptions( false );
+    static const google::protobuf::util::JsonPrintOptions whitespaceOptions = makePrintOptions( true );
+    return addWhitespace ? whitespaceOptions : options;
+  }
+
+  static google::protobuf::util::JsonPrintOptions makePrintOptions( bool addWhitespace )
   {
     google::protobuf::util::JsonPrintOptions options;
     options.add_whitespace = addWhitespace;
     options.always_print_primitive_fields = true;
     options.preserve_proto_field_names = true;
     options.always_print_enums_as_ints = true;
-    return google::protobuf::util::MessageToJsonString( message, &jsonStr, options ).ok();
+    return options;
   }
 
-  static bool JsonStr2Pb( const std::string& jsonStr, google::protobuf::Message& message )
+  static bool isWellKnownType( const google::protobuf::Descriptor* descriptor )
   {
-    return google::protobuf::util::JsonStringToMessage( jsonStr, &message ).ok();
+    return descriptor->file()->package() == "google.protobuf";
   }
 
-  static bool Pb2Json( const google::protobuf::Message& message, Json::Value& value )
+  static bool wellKnown2Json( const google::protobuf::Message& message, Json::Value& value )
   {
     std::string jsonStr;
     if ( !Pb2JsonStr( message, jsonStr ) ) {
       return false;
     }
-
     Json::CharReaderBuilder readerBuilder;
-    std::istringstream iss { jsonStr };
-    std::string errs;
-    return Json::parseFromStream( readerBuilder, iss, &value, &errs );
+    std::unique_ptr<Json::CharReader> reader { readerBuilder.newCharReader() };
+    return reader->parse( jsonStr.data(), jsonStr.data() + jsonStr.size(), &value, nullptr );
   }
 
-  static bool Json2Pb( Json::Value& value, google::protobuf::Message& message )
+  static bool json2WellKnown( const Json::Value& value, google::protobuf::Message& message )
   {
     Json::StreamWriterBuilder writerBuilder;
-    std::unique_ptr<Json::StreamWriter> writer { writerBuilder.newStreamWriter() };
-    std::ostringstream oss;
-    writer->write( value, &oss );
-    std::string jsonStr = oss.str();
-    return JsonStr2Pb( jsonStr, message );
+    writerBuilder["indentation"] = "";
+    return JsonStr2Pb( Json::writeString( writerBuilder, value ), message );
+  }
+
+  static bool field2Json( const google::protobuf::Message& message,
+                          const google::protobuf::FieldDescriptor* field,
+                          Json::Value& value )
+  {
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    if ( field->is_map() ) {
+      value = Json::Value( Json::objectValue );
+      const google::protobuf::FieldDescriptor* keyField = field->message_type()->map_key();
+      const google::protobuf::FieldDescriptor* valueField = field->message_type()->map_value();
+      for ( int i = 0; i < reflection->FieldSize( message, field ); ++i ) {
+        const google::protobuf::Message& entry = reflection->GetRepeatedMessage( message, field, i );
+        if ( !value2Json( entry, valueField, -1, value[mapKey2Str( entry, keyField )] ) ) {
+          return false;
+        }
+      }
+      return true;
+    }
+    if ( field->is_repeated() ) {
+      value = Json::Value( Json::arrayValue );
+      for ( int i = 0; i < reflection->FieldSize( message, field ); ++i ) {
+        if ( !value2Json( message, field, i, value.append( Json::Value() ) ) ) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return value2Json( message, field, -1, value );
+  }
+
+  // index小于0时读取单值字段，否则读取repeated字段的第index个元素
+  static bool value2Json( const google::protobuf::Message& message,
+                          const google::protobuf::FieldDescriptor* field,
+                          int index,
+                          Json::Value& value )
+  {
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Reflection* r = message.GetReflection();
+    bool single = index < 0;
+    switch ( field->cpp_type() ) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        value = single ? r->GetInt32( message, field ) : r->GetRepeatedInt32( message, field, index );
+        return true;
+      case FieldDescriptor::CPPTYPE_UINT32: // jsoncpp解析json串得到的整数都是Int64，这里保持一致
+        value = Json::Int64( single ? r->GetUInt32( message, field ) : r->GetRepeatedUInt32( message, field, index ) );
+        return true;
+      case FieldDescriptor::CPPTYPE_INT64: // 64位整数按照proto3的json规范输出为字符串
+        value = std::to_string( single ? r->GetInt64( message, field ) : r->GetRepeatedInt64( message, field, index ) );
+        return true;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        value = std::to_string( single ? r->GetUInt64( message, field )
+                                       : r->GetRepeatedUInt64( message, field, index ) );
+        return true;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        double2Json( single ? r->GetDouble( message, field ) : r->GetRepeatedDouble( message, field, index ), value );
+        return true;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        float2Json( single ? r->GetFloat( message, field ) : r->GetRepeatedFloat( message, field, index ), value );
+        return true;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        value = single ? r->GetBool( message, field ) : r->GetRepeatedBool( message, field, index );
+        return true;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        value = single ? r->GetEnumValue( message, field ) : r->GetRepeatedEnumValue( message, field, index );
+        return true;
+      case FieldDescriptor::CPPTYPE_STRING: {
+        std::string scratch;
+        const std::string& str = single ? r->GetStringReference( message, field, &scratch )
+                                        : r->GetRepeatedStringReference( message, field, index, &scratch );
+        if ( FieldDescriptor::TYPE_BYTES == field->type() ) {
+          std::string base64;
+          google::protobuf::Base64Escape( str, &base64 );
+          value = std::move( base64 );
+        } else {
+          value = str;
+        }
+        return true;
+      }
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        return Pb2Json( single ? r->GetMessage( message, field ) : r->GetRepeatedMessage( message, field, index ),
+                        value );
+    }
+    return false;
+  }
+
+  static void double2Json( double d, Json::Value& value )
+  {
+    if ( std::isnan( d ) ) {
+      value = "NaN";
+    } else if ( std::isinf( d ) ) {
+      value = d > 0 ? "Infinity" : "-Infinity";
+    } else {
+      value = d;
+    }
+  }
+
+  // float先按最短的十进制表示再转成double，和json串中的值一致，例如0.1f得到0.1而不是0.10000000149
+  static void float2Json( float f, Json::Value& value )
+  {
+    if ( std::isnan( f ) || std::isinf( f ) ) {
+      double2Json( f, value );
+      return;
+    }
+    char buf[32];
+    auto result = std::to_chars( buf, buf + sizeof( buf ), f );
+    double d = 0;
+    std::from_chars( buf, result.ptr, d );
+    value = d;
+  }
+
+  static std::string mapKey2Str( const google::protobuf::Message& entry,
+                                 const google::protobuf::FieldDescriptor* field )
+  {
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Reflection* r = entry.GetReflection();
+    switch ( field->cpp_type() ) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        return std::to_string( r->GetInt32( entry, field ) );
+      case FieldDescriptor::CPPTYPE_UINT32:
+        return std::to_string( r->GetUInt32( entry, field ) );
+      case FieldDescriptor::CPPTYPE_INT64:
+        return std::to_string( r->GetInt64( entry, field ) );
+      case FieldDescriptor::CPPTYPE_UINT64:
+        return std::to_string( r->GetUInt64( entry, field ) );
+      case FieldDescriptor::CPPTYPE_BOOL:
+        return r->GetBool( entry, field ) ? "true" : "false";
+      default:
+        return r->GetString( entry, field );
+    }
+  }
+
+  static bool json2Message( const Json::Value& value, google::protobuf::Message& message )
+  {
+    const google::protobuf::Descriptor* descriptor = message.GetDescriptor();
+    if ( isWellKnownType( descriptor ) ) {
+      return json2WellKnown( value, message );
+    }
+    if ( !value.isObject() ) {
+      return false;
+    }
+    for ( auto iter = value.begin(); iter != value.end(); ++iter ) {
+      std::string name = iter.name();
+      const google::protobuf::FieldDescriptor* field = descriptor->FindFieldByName( name );
+      if ( nullptr == field ) {
+        field = descriptor->FindFieldByCamelcaseName( name );
+      }
+      if ( nullptr == field ) {
+        return false;
+      }
+      // null表示字段取默认值，只有google.protobuf.Value用null表示NULL_VALUE
+      bool isValue = field->message_type() != nullptr && field->message_type()->full_name() == "google.protobuf.Value";
+      if ( iter->isNull() && !isValue ) {
+        continue;
+      }
+      if ( !json2Field( *iter, message, field ) ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool json2Field( const Json::Value& value,
+                          google::protobuf::Message& message,
+                          const google::protobuf::FieldDescriptor* field )
+  {
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    if ( field->is_map() ) {
+      if ( !value.isObject() ) {
+        return false;
+      }
+      const google::protobuf::FieldDescriptor* keyField = field->message_type()->map_key();
+      const google::protobuf::FieldDescriptor* valueField = field->message_type()->map_value();
+      for ( auto iter = value.begin(); iter != value.end(); ++iter ) {
+        google::protobuf::Message* entry = reflection->AddMessage( &message, field );
+        if ( !str2MapKey( iter.name(), *entry, keyField ) || !json2Value( *iter, *entry, valueField ) ) {
+          return false;
+        }
+      }
+      return true;
+    }
+    if ( field->is_repeated() ) {
+      if ( !value.isArray() ) {
+        return false;
+      }
+      for ( const Json::Value& element : value ) {
+        if ( !json2Value( element, message, field ) ) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return json2Value( value, message, field );
+  }
+
+  // repeated字段追加一个元素，否则设置字段的值
+  static bool json2Value( const Json::Value& value,
+                          google::protobuf::Message& message,
+                          const google::protobuf::FieldDescriptor* field )
+  {
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Reflection* r = message.GetReflection();
+    bool repeated = field->is_repeated();
+    int64_t i64 = 0;
+    uint64_t u64 = 0;
+    double d = 0;
+    switch ( field->cpp_type() ) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        if ( !json2Int( value, i64 ) || i64 < INT32_MIN || i64 > INT32_MAX ) {
+          return false;
+        }
+        repeated ? r->AddInt32( &message, field, i64 ) : r->SetInt32( &message, field, i64 );
+        return true;
+      case FieldDescriptor::CPPTYPE_UINT32:
+        if ( !json2UInt( value, u64 ) || u64 > UINT32_MAX ) {
+          return false;
+        }
+        repeated ? r->AddUInt32( &message, field, u64 ) : r->SetUInt32( &message, field, u64 );
+        return true;
+      case FieldDescriptor::CPPTYPE_INT64:
+        if ( !json2Int( value, i64 ) ) {
+          return false;
+        }
+        repeated ? r->AddInt64( &message, field, i64 ) : r->SetInt64( &message, field, i64 );
+        return true;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        if ( !json2UInt( value, u64 ) ) {
+          return false;
+        }
+        repeated ? r->AddUInt64( &message, field, u64 ) : r->SetUInt64( &message, field, u64 );
+        return true;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        if ( !json2Double( value, d ) ) {
+          return false;
+        }
+        repeated ? r->AddDouble( &message, field, d ) : r->SetDouble( &message, field, d );
+        return true;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        if ( !json2Double( value, d ) || ( std::isfinite( d ) && std::fabs( d ) > FLT_MAX ) ) {
+          return false;
+        }
+        repeated ? r->AddFloat( &message, field, d ) : r->SetFloat( &message, field, d );
+        return true;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        if ( !value.isBool() ) {
+          return false;
+        }
+        repeated ? r->AddBool( &message, field, value.asBool() ) : r->SetBool( &message, field, value.asBool() );
+        return true;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        return json2Enum( value, message, field );
+      case FieldDescriptor::CPPTYPE_STRING: {
+        if ( !value.isString() ) {
+          return false;
+        }
+        std::string str;
+        if ( FieldDescriptor::TYPE_BYTES != field->type() ) {
+          str = value.asString();
+        } else if ( !google::protobuf::Base64Unescape( value.asString(), &str )
+                    && !google::protobuf::WebSafeBase64Unescape( value.asString(), &str ) ) {
+          return false;
+        }
+        repeated ? r->AddString( &message, field, std::move( str ) )
+                 : r->SetString( &message, field, std::move( str ) );
+        return true;
+      }
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        return json2Message( value,
+                             repeated ? *r->AddMessage( &message, field ) : *r->MutableMessage( &message, field ) );
+    }
+    return false;
+  }
+
+  // enum可以是名字，也可以是整数，proto3的enum是开放的，允许未定义的整数值
+  static bool json2Enum( const Json::Value& value,
+                         google::protobuf::Message& message,
+                         const google::protobuf::FieldDescriptor* field )
+  {
+    const google::protobuf::EnumDescriptor* enumType = field->enum_type();
+    int number = 0;
+    if ( value.isString() ) {
+      const google::protobuf::EnumValueDescriptor* enumValue = enumType->FindValueByName( value.asString() );
+      if ( nullptr == enumValue ) {
+        return false;
+      }
+      number = enumValue->number();
+    } else if ( value.isInt() ) {
+      number = value.asInt();
+      bool isOpen = google::protobuf::FileDescriptor::SYNTAX_PROTO3 == enumType->file()->syntax();
+      if ( !isOpen && nullptr == enumType->FindValueByNumber( number ) ) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    const google::protobuf::Reflection* r = message.GetReflection();
+    field->is_repeated() ? r->AddEnumValue( &message, field, number ) : r->SetEnumValue( &message, field, number );
+    return true;
+  }
+
+  // 整数可以是数字，也可以是字符串（64位整数按规范输出为字符串）
+  static bool json2Int( const Json::Value& value, int64_t& n )
+  {
+    if ( value.isString() ) {
+      return str2Number( value, n );
+    }
+    if ( !value.isInt64() ) {
+      return false;
+    }
+    n = value.asInt64();
+    return true;
+  }
+
+  static bool json2UInt( const Json::Value& value, uint64_t& n )
+  {
+    if ( value.isString() ) {
+      return str2Number( value, n );
+    }
+    if ( !value.isUInt64() ) {
+      return false;
+    }
+    n = value.asUInt64();
+    return true;
+  }
+
+  static bool json2Double( const Json::Value& value, double& d )
+  {
+    if ( value.isNumeric() ) {
+      d = value.asDouble();
+      return true;
+    }
+    if ( !value.isString() ) {
+      return false;
+    }
+    const std::string& str = value.asString();
+    if ( "NaN" == str ) {
+      d = NAN;
+    } else if ( "Infinity" == str ) {
+      d = INFINITY;
+    } else if ( "-Infinity" == str ) {
+      d = -INFINITY;
+    } else {
+      return str2Number( value, d );
+    }
+    return true;
+  }
+
+  // 整个字符串都必须是合法的数字
+  template <typename T>
+  static bool str2Number( const Json::Value& value, T& n )
+  {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    if ( !value.getString( &begin, &end ) || begin == end ) {
+      return false;
+    }
+    auto result = std::from_chars( begin, end, n );
+    return result.ec == std::errc() && result.ptr == end;
+  }
+
+  static bool str2MapKey( const std::string& key,
+                          google::protobuf::Message& entry,
+                          const google::protobuf::FieldDescriptor* field )
+  {
+    using google::protobuf::FieldDescriptor;
+    const google::protobuf::Reflection* r = entry.GetReflection();
+    if ( FieldDescriptor::CPPTYPE_STRING == field->cpp_type() ) {
+      r->SetString( &entry, field, key );
+      return true;
+    }
+    if ( FieldDescriptor::CPPTYPE_BOOL == field->cpp_type() ) {
+      if ( key != "true" && key != "false" ) {
+        return false;
+      }
+      r->SetBool( &entry, field, "true" == key );
+      return true;
+    }
+    // 整数类型的key复用整数字段的解析和范围检查
+    return json2Value( Json::Value( key ), entry, field );
   }
 };
 }  // namespace Common
\ No newline at end of file
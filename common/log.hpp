@@ -7,10 +7,23 @@
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include "logbinary.hpp"
+#include "logid.hpp"
 #include "robustio.hpp"
 #include "singleton.hpp"
 #include "strings.hpp"
@@ -18,6 +31,17 @@
 #include "utils.hpp"
 
 namespace Common {
+constexpr size_t LOG_LINE_LEN = 1024;                 // 日志内容第一次格式化使用的长度，不够时按实际长度重新格式化
+constexpr size_t LOG_THREAD_BUFFER_LEN = 1024 * 1024; // 异步模式下每个线程的缓冲区大小，必须是2的幂
+constexpr size_t LOG_FLUSH_LEN = 64 * 1024;           // 线程缓冲区积累的数据超过该值时立即唤醒刷盘线程
+constexpr uint32_t LOG_FLUSH_INTERVAL_MS = 100;       // 刷盘线程最长的刷盘间隔
+constexpr int LOG_MAX_IOV = 1024;                     // 一次writev最多使用的iov个数（IOV_MAX）
+
+// 编译期的最低日志级别，低于该级别的日志宏不产生任何代码，例如-DLOG_MIN_LEVEL=2只保留INFO及以上
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 // 日志输出级别
 enum LogLevel
 {
@@ -28,7 +52,120 @@ enum LogLevel
   LEVEL_ERROR = 4,
 };
 
-// 日志文件类
+inline const char* LogLevelStr( LogLevel level )
+{
+  if ( LEVEL_TRACE == level ) {
+    return "[TRACE]";
+  }
+  if ( LEVEL_DEBUG == level ) {
+    return "[DEBUG]";
+  }
+  if ( LEVEL_INFO == level ) {
+    return "[INFO]";
+  }
+  if ( LEVEL_WARN == level ) {
+    return "[WARN]";
+  }
+  if ( LEVEL_ERROR == level ) {
+    return "[ERROR]";
+  }
+  return "UNKNOWN";
+}
+
+// 去掉路径只保留文件名，传入字符串字面量时在编译期求值
+constexpr const char* LogFileName( const char* path )
+{
+  const char* name = path;
+  for ( const char* p = path; *p != '\0'; ++p ) {
+    if ( '/' == *p ) {
+      name = p + 1;
+    }
+  }
+  return name;
+}
+
+/* 日志宏展开处的静态对象，记录位置信息和格式串，常量初始化，不需要运行时构造
+ * 二进制模式下第一次写日志时分配编号，之后的日志只记录编号和参数
+ */
+struct LogSite
+{
+  constexpr LogSite( LogLevel level, const char* file, const char* function, int line, bool hasCid, const char* format )
+    : level_( level ), file_( file ), function_( function ), line_( line ), has_cid_( hasCid ), format_( format )
+  {
+  }
+
+  LogLevel level_;
+  const char* file_;
+  const char* function_;
+  int line_;
+  bool has_cid_;                   // 是否输出协程id，CTX_XXX宏为true
+  const char* format_;             // 不包含位置前缀的格式串
+  std::atomic<uint32_t> id_ { 0 }; // 二进制模式下的位置编号，0表示还没有分配
+};
+
+/* 单生产者单消费者的环形缓冲区，生产者是写日志的线程，消费者是刷盘线程，不需要加锁
+ * 读写位置只增不减，取模之后才是缓冲区中的偏移
+ */
+class LogBuffer
+{
+public:
+  explicit LogBuffer( size_t len ) : data_( new char[len] ), len_( len ) { assert( ( len & ( len - 1 ) ) == 0 ); }
+
+  size_t Capacity() const { return len_; }
+  size_t Size() const
+  {
+    return write_pos_.load( std::memory_order_acquire ) - read_pos_.load( std::memory_order_acquire );
+  }
+
+  // 生产者调用，剩余空间不足时返回false
+  bool Append( const char* data, size_t len )
+  {
+    uint64_t writePos = write_pos_.load( std::memory_order_relaxed );
+    if ( len > len_ - ( writePos - read_pos_.load( std::memory_order_acquire ) ) ) {
+      return false;
+    }
+    size_t offset = writePos & ( len_ - 1 );
+    size_t first = std::min( len, len_ - offset ); // 写到缓冲区末尾之后回绕到开头
+    memcpy( data_.get() + offset, data, first );
+    memcpy( data_.get(), data + first, len - first );
+    write_pos_.store( writePos + len, std::memory_order_release );
+    return true;
+  }
+
+  // 消费者调用，待写入的数据放到iov中（回绕时有两段），返回使用的iov个数，end为写完之后的读位置
+  int Peek( struct iovec* iov, uint64_t& end )
+  {
+    uint64_t readPos = read_pos_.load( std::memory_order_relaxed );
+    end = write_pos_.load( std::memory_order_acquire );
+    size_t len = end - readPos;
+    if ( 0 == len ) {
+      return 0;
+    }
+    size_t offset = readPos & ( len_ - 1 );
+    size_t first = std::min( len, len_ - offset );
+    iov[0] = { data_.get() + offset, first };
+    if ( first == len ) {
+      return 1;
+    }
+    iov[1] = { data_.get(), len - first };
+    return 2;
+  }
+
+  // 消费者调用，数据写入文件之后才释放空间
+  void Consume( uint64_t end ) { read_pos_.store( end, std::memory_order_release ); }
+
+private:
+  std::unique_ptr<char[]> data_;
+  size_t len_;
+  alignas( 64 ) std::atomic<uint64_t> write_pos_ { 0 }; // 读写位置放在不同的缓存行，避免伪共享
+  alignas( 64 ) std::atomic<uint64_t> read_pos_ { 0 };
+};
+
+/* 日志文件类
+ * 默认同步写，每条日志一次write。EnableAsync之后，日志先追加到当前线程私有的环形缓冲区中，
+ * 由刷盘线程定时或者在缓冲区积累了足够多的数据时，把所有线程的数据合并成一次writev写入文件
+ * EnableBinary之后写二进制日志，格式见logbinary.hpp，和异步写可以同时开启
+ */
 class Logger
 {
 public:
@@ -44,158 +181,402 @@ public:
     srand( time( nullptr ) );
   }
 
-  void SetLevel( LogLevel level ) { level_ = level; }
+  ~Logger()
+  {
+    if ( !flusher_.joinable() ) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock( mutex_ );
+      stop_ = true;
+    }
+    cond_.notify_one();
+    flusher_.join(); // 退出之前刷盘线程会把所有缓冲区中剩余的日志写完
+  }
+
+  void SetLevel( LogLevel level ) { level_.store( level, std::memory_order_relaxed ); }
+  bool IsEnabled( LogLevel level ) const { return level >= level_.load( std::memory_order_relaxed ); }
+
+  // 异步模式下还没有释放的线程缓冲区个数，线程退出并且日志写完之后由刷盘线程释放
+  size_t ThreadBufferCount()
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return buffers_.size();
+  }
+
+  /* 开启异步写，只能调用一次，一般在启动时调用
+   * threadBufferLen为每个线程的缓冲区大小，必须是2的幂，否则返回false并保持同步写
+   * 缓冲区满时写日志的线程会等待刷盘线程腾出空间，日志不会丢失
+   */
+  bool EnableAsync( size_t threadBufferLen = LOG_THREAD_BUFFER_LEN, uint32_t flushIntervalMs = LOG_FLUSH_INTERVAL_MS )
+  {
+    if ( 0 == threadBufferLen || 0 != ( threadBufferLen & ( threadBufferLen - 1 ) ) ) {
+      return false; // 环形缓冲区用掩码计算偏移
+    }
+    if ( async_.load() ) {
+      return true;
+    }
+    thread_buffer_len_ = threadBufferLen;
+    flush_interval_ms_ = flushIntervalMs;
+    flusher_ = std::thread( &Logger::flushLoop, this );
+    async_.store( true, std::memory_order_release );
+    return true;
+  }
+
+  /* 开启二进制模式，改为写入xxx.binlog文件，需要在写第一条日志和EnableAsync之前调用
+   * 经过日志宏的日志只记录位置编号和参数的原始字节，不做格式化，用tools/logdecode还原成文本
+   */
+  bool EnableBinary()
+  {
+    std::string programName = Utils::GetSelfName();
+    std::string fileName
+      = Strings::StrFormat( "/home/backend/log/%s/%s.binlog", programName.c_str(), programName.c_str() );
+    int fd = open( fileName.c_str(), O_APPEND | O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+    if ( fd < 0 ) {
+      return false;
+    }
+    close( fd_ );
+    fd_ = fd;
+    binary_ = true;
+    return true;
+  }
 
-  void Log( std::string logId, LogLevel level, char* format, ... )
+  void Log( std::string_view logId, LogLevel level, char* format, ... )
   {
-    if ( level < level_ ) {
+    if ( !IsEnabled( level ) ) {
       return;
     }
 
-    int32_t ret;
-    std::vector<char> buf( 1024 );
+    char genLogId[LOG_ID_LEN];
+    if ( logId.empty() ) {
+      LogId::Gen( genLogId );
+      logId = std::string_view( genLogId, LOG_ID_LEN );
+    }
+
+    // 整行日志格式化到线程私有的缓冲区中，复用内存，不产生临时的std::string
+    thread_local std::string line;
+    line.clear();
+    if ( !binary_ ) {
+      appendLinePrefix( line, level, logId );
+    }
     va_list plist;
     va_start( plist, format );
-    ret = vsnprintf( buf.data(), 1024, format, plist );
+    appendFormatV( line, format, plist );
     va_end( plist );
-    assert( ret > 0 );
+    if ( binary_ ) { // 无法拆分参数，格式化之后作为文本记录写入
+      writeBinaryText( level, logId, line );
+      return;
+    }
+    line.push_back( '\n' );
+    output( line.data(), line.size() );
+  }
 
-    if ( ret >= 1024 ) { // 缓冲区长度不足，需要重新分配内存
-      buf.reserve( ret + 1 );
-      va_start( plist, format );
-      ret = vsnprintf( buf.data(), ret + 1, format, plist );
-      va_end( plist );
+  // 日志宏调用的入口，文本模式下和Log的输出一致，二进制模式下只记录参数
+  template <typename... Args>
+  void Write( LogSite& site, std::string_view logId, int32_t cid, const Args&... args )
+  {
+    char genLogId[LOG_ID_LEN];
+    if ( logId.empty() ) {
+      LogId::Gen( genLogId );
+      logId = std::string_view( genLogId, LOG_ID_LEN );
     }
 
-    if ( logId == "" ) {
-      logId = GetLogId();
+    thread_local std::string line;
+    line.clear();
+    if ( binary_ ) {
+      writeBinary( site, logId, cid, line, args... );
+      return;
+    }
+    appendLinePrefix( line, site.level_, logId );
+    if ( site.has_cid_ ) {
+      appendFormat( line, "(%d:%s:%s:%d):", cid, site.file_, site.function_, site.line_ );
+    } else {
+      appendFormat( line, "(%s:%s:%d):", site.file_, site.function_, site.line_ );
+    }
+    appendFormat( line, site.format_, args... );
+    line.push_back( '\n' );
+    output( line.data(), line.size() );
+  }
+
+  static std::string GetLogId() { return LogId::Gen(); }
+
+private:
+  void appendLinePrefix( std::string& line, LogLevel level, std::string_view logId )
+  {
+    line.append( LogLevelStr( level ) ).append( " " ).append( TimeCache::LogTimeStr() ).append( " " );
+    line.append( std::to_string( getpid() ) ).append( "," ).append( logId ).append( " " );
+  }
+
+  void appendFormat( std::string& line, const char* format, ... )
+  {
+    va_list plist;
+    va_start( plist, format );
+    appendFormatV( line, format, plist );
+    va_end( plist );
+  }
+
+  void appendFormatV( std::string& line, const char* format, va_list plist )
+  {
+    size_t prefixLen = line.size();
+    line.resize( prefixLen + LOG_LINE_LEN );
+    va_list retry;
+    va_copy( retry, plist );
+    int32_t ret = vsnprintf( line.data() + prefixLen, LOG_LINE_LEN, format, plist );
+    assert( ret >= 0 );
+    if ( static_cast<size_t>( ret ) >= LOG_LINE_LEN ) { // 缓冲区长度不足，按实际长度重新格式化
+      line.resize( prefixLen + ret + 1 );
+      vsnprintf( line.data() + prefixLen, ret + 1, format, retry );
+    }
+    va_end( retry );
+    line.resize( prefixLen + ret );
+  }
+
+  void appendBinaryHeader( std::string& record, uint32_t siteId, int32_t cid )
+  {
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME_COARSE, &now ); // 和TimeCache使用相同的时钟
+    LogBinaryHeader header { 0, siteId, now.tv_sec * 1'000'000 + now.tv_nsec / 1000, uint32_t( getpid() ), cid };
+    LogBinary::AppendRaw( record, header );
+  }
+
+  void appendBinaryLogId( std::string& record, std::string_view logId )
+  {
+    logId = logId.substr( 0, LOG_BINARY_MAX_LOG_ID_LEN );
+    LogBinary::AppendRaw( record, static_cast<uint8_t>( logId.size() ) );
+    record.append( logId );
+  }
+
+  // 回填记录长度之后输出
+  void outputBinary( std::string& record )
+  {
+    uint32_t len = record.size();
+    memcpy( record.data(), &len, sizeof( len ) );
+    output( record.data(), record.size() );
+  }
+
+  template <typename... Args>
+  void writeBinary( LogSite& site, std::string_view logId, int32_t cid, std::string& record, const Args&... args )
+  {
+    uint32_t siteId = site.id_.load( std::memory_order_acquire );
+    if ( 0 == siteId ) {
+      static constexpr std::array<uint8_t, sizeof...( Args )> types { LogBinaryArgType<Args>()... };
+      siteId = defineSite( site, types.data(), types.size() );
+    }
+    appendBinaryHeader( record, siteId, cid );
+    appendBinaryLogId( record, logId );
+    ( LogBinary::AppendArg( record, args ), ... );
+    outputBinary( record );
+  }
+
+  void writeBinaryText( LogLevel level, std::string_view logId, std::string& text )
+  {
+    thread_local std::string record;
+    record.clear();
+    appendBinaryHeader( record, LOG_BINARY_TEXT, 0 );
+    appendBinaryLogId( record, logId );
+    LogBinary::AppendRaw( record, static_cast<uint8_t>( level ) );
+    LogBinary::AppendString( record, text );
+    outputBinary( record );
+  }
+
+  /* 分配位置编号并直接写入位置定义，写完之后才发布编号
+   * 使用该编号的日志记录无论同步写还是经过缓冲区，在文件中一定位于定义之后
+   */
+  uint32_t defineSite( LogSite& site, const uint8_t* types, size_t argCnt )
+  {
+    std::lock_guard<std::mutex> lock( site_mutex_ );
+    uint32_t siteId = site.id_.load( std::memory_order_relaxed );
+    if ( siteId != 0 ) {
+      return siteId;
     }
+    siteId = next_site_id_++;
+    std::string record;
+    appendBinaryHeader( record, LOG_BINARY_SITE_DEFINE, 0 );
+    LogBinary::AppendRaw( record, siteId );
+    LogBinary::AppendRaw( record, static_cast<uint8_t>( site.level_ ) );
+    LogBinary::AppendRaw( record, static_cast<uint32_t>( site.line_ ) );
+    LogBinary::AppendRaw( record, static_cast<uint8_t>( site.has_cid_ ) );
+    LogBinary::AppendRaw( record, static_cast<uint8_t>( argCnt ) );
+    record.append( reinterpret_cast<const char*>( types ), argCnt );
+    LogBinary::AppendString( record, site.file_ );
+    LogBinary::AppendString( record, site.function_ );
+    LogBinary::AppendString( record, site.format_ );
+    uint32_t len = record.size();
+    memcpy( record.data(), &len, sizeof( len ) );
+    RobustIo io( fd_ );
+    io.Write( reinterpret_cast<uint8_t*>( record.data() ), record.size() );
+    site.id_.store( siteId, std::memory_order_release );
+    return siteId;
+  }
 
-    std::string timeStr = TimeFormat::GetTimeStr( "%F %T", true );
-    std::string logMsg
-      = levelStr( level ) + " " + timeStr + " " + std::to_string( getpid() ) + "," + logId + " " + buf.data() + "\n";
+  void output( const char* data, size_t len )
+  {
+    if ( async_.load( std::memory_order_acquire ) ) {
+      asyncWrite( data, len );
+      return;
+    }
     RobustIo io( fd_ );
-    io.Write( reinterpret_cast<uint8_t*>( logMsg.data() ), logMsg.size() );
+    io.Write( reinterpret_cast<uint8_t*>( const_cast<char*>( data ) ), len );
   }
 
-  static std::string GetLogId()
+  void asyncWrite( const char* data, size_t len )
   {
-    static std::string ip = Common::Utils::GetIpStr( "eth0" ); // 默认取eth0的ip
-    std::string curTime = TimeFormat::GetTimeStr( "%Y%m%d%H%M%S" );
-    return curTime + ip + std::to_string( rand() % 1'000'000 );
+    LogBuffer& buffer = threadBuffer();
+    if ( len > buffer.Capacity() ) { // 比整个缓冲区还大的日志，等缓冲区刷完之后直接写入，保证同一个线程的日志有序
+      while ( buffer.Size() > 0 ) {
+        wakeFlusher();
+        std::this_thread::yield();
+      }
+      RobustIo io( fd_ );
+      io.Write( reinterpret_cast<uint8_t*>( const_cast<char*>( data ) ), len );
+      return;
+    }
+    while ( !buffer.Append( data, len ) ) { // 缓冲区满了，等待刷盘线程腾出空间
+      wakeFlusher();
+      std::this_thread::yield();
+    }
+    if ( buffer.Size() >= LOG_FLUSH_LEN ) {
+      wakeFlusher();
+    }
   }
 
-private:
-  std::string levelStr( LogLevel level )
+  // 刷盘线程处理完之前只唤醒一次，避免每条日志都产生一次系统调用
+  void wakeFlusher()
   {
-    if ( LEVEL_TRACE == level ) {
-      return "[TRACE]";
+    if ( !flush_requested_.exchange( true, std::memory_order_acq_rel ) ) {
+      cond_.notify_one();
     }
-    if ( LEVEL_DEBUG == level ) {
-      return "[DEBUG]";
+  }
+
+  // 线程第一次写日志时创建缓冲区并注册给刷盘线程，线程退出后缓冲区由刷盘线程写完之后释放
+  LogBuffer& threadBuffer()
+  {
+    thread_local std::shared_ptr<LogBuffer> buffer;
+    if ( nullptr == buffer ) {
+      buffer = std::make_shared<LogBuffer>( thread_buffer_len_ );
+      std::lock_guard<std::mutex> lock( mutex_ );
+      buffers_.push_back( buffer );
     }
-    if ( LEVEL_INFO == level ) {
-      return "[INFO]";
+    return *buffer;
+  }
+
+  void flushLoop()
+  {
+    std::vector<std::shared_ptr<LogBuffer>> buffers;
+    std::unique_lock<std::mutex> lock( mutex_ );
+    while ( true ) {
+      // 没有使用条件判断，notify和wait之间的竞争最多导致多等待一个刷盘间隔
+      if ( !stop_ && !flush_requested_.load( std::memory_order_acquire ) ) {
+        cond_.wait_for( lock, std::chrono::milliseconds( flush_interval_ms_ ) );
+      }
+      bool stop = stop_;
+      flush_requested_.store( false, std::memory_order_release );
+      // 所属线程已经退出并且写完了的缓冲区直接释放
+      buffers_.erase( std::remove_if( buffers_.begin(),
+                                      buffers_.end(),
+                                      []( const std::shared_ptr<LogBuffer>& buffer ) {
+                                        return 1 == buffer.use_count() && 0 == buffer->Size();
+                                      } ),
+                      buffers_.end() );
+      buffers = buffers_;
+      lock.unlock(); // 写文件时不持有锁，不影响新线程注册缓冲区
+      flushBuffers( buffers );
+      buffers.clear(); // 不再持有缓冲区，否则下一轮use_count不会是1，退出线程的缓冲区永远不会释放
+      lock.lock();
+      if ( stop ) {
+        break;
+      }
     }
-    if ( LEVEL_WARN == level ) {
-      return "[WARN]";
+  }
+
+  // 所有线程的数据合并成尽量少的writev，写完之后才释放缓冲区的空间
+  void flushBuffers( const std::vector<std::shared_ptr<LogBuffer>>& buffers )
+  {
+    struct iovec iov[LOG_MAX_IOV];
+    std::pair<LogBuffer*, uint64_t> consumed[LOG_MAX_IOV];
+    int iovCnt = 0;
+    int consumedCnt = 0;
+    auto flush = [&]() {
+      RobustIo io( fd_ );
+      io.Writev( iov, iovCnt );
+      for ( int i = 0; i < consumedCnt; ++i ) {
+        consumed[i].first->Consume( consumed[i].second );
+      }
+      iovCnt = 0;
+      consumedCnt = 0;
+    };
+    for ( const auto& buffer : buffers ) {
+      if ( iovCnt + 2 > LOG_MAX_IOV ) {
+        flush();
+      }
+      uint64_t end = 0;
+      int cnt = buffer->Peek( iov + iovCnt, end );
+      if ( cnt > 0 ) {
+        iovCnt += cnt;
+        consumed[consumedCnt++] = { buffer.get(), end };
+      }
     }
-    if ( LEVEL_ERROR == level ) {
-      return "[ERROR]";
+    if ( iovCnt > 0 ) {
+      flush();
     }
-    return "UNKNOWN";
   }
 
 protected:
-  LogLevel level_ { LEVEL_TRACE }; // 日志级别
-  int fd_ { -1 };                  // 文件句柄
+  std::atomic<LogLevel> level_ { LEVEL_TRACE }; // 日志级别，运行时可以被其它线程修改
+  int fd_ { -1 };                               // 文件句柄
+
+private:
+  std::atomic<bool> async_ { false };                    // 是否开启了异步写
+  std::atomic<bool> flush_requested_ { false };          // 是否已经唤醒了刷盘线程
+  size_t thread_buffer_len_ { LOG_THREAD_BUFFER_LEN };   // 每个线程的缓冲区大小
+  uint32_t flush_interval_ms_ { LOG_FLUSH_INTERVAL_MS }; // 刷盘间隔
+  std::thread flusher_;                                  // 刷盘线程
+  std::mutex mutex_;                                     // 保护buffers_和stop_
+  std::condition_variable cond_;                         // 唤醒刷盘线程
+  bool stop_ { false };                                  // 刷盘线程是否需要退出
+  std::vector<std::shared_ptr<LogBuffer>> buffers_;      // 所有线程的缓冲区
+  bool binary_ { false };                                // 是否开启了二进制模式
+  std::mutex site_mutex_;                                // 保护位置编号的分配
+  uint32_t next_site_id_ { LOG_BINARY_FIRST_SITE };      // 下一个位置编号
 };
 
 }  // namespace Common
 
 #define LOGGER Common::Singleton<Common::Logger>::Instance()
-#define FILENAME( x ) strrchr( x, '/' ) ? strrchr( x, '/' ) + 1 : x
-#define TRACE( format, ... )                                                                                           \
-  LOGGER.Log( "",                                                                                                      \
-              Common::LEVEL_TRACE,                                                                                     \
-              (char*)"(%s:%s:%d):" format,                                                                             \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
-
-#define DEBUG( format, ... )                                                                                           \
-  LOGGER.Log( "",                                                                                                      \
-              Common::LEVEL_DEBUG,                                                                                     \
-              (char*)"(%s:%s:%d):" format,                                                                             \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
-
-#define INFO( format, ... )                                                                                            \
-  LOGGER.Log(                                                                                                          \
-    "", Common::LEVEL_INFO, (char*)"(%s:%s:%d):" format, FILENAME( __FILE__ ), __FUNCTION__, __LINE__, ##__VA_ARGS__ )
-
-#define WARN( format, ... )                                                                                            \
-  LOGGER.Log(                                                                                                          \
-    "", Common::LEVEL_WARN, (char*)"(%s:%s:%d):" format, FILENAME( __FILE__ ), __FUNCTION__, __LINE__, ##__VA_ARGS__ )
-
-#define ERROR( format, ... )                                                                                           \
-  LOGGER.Log( "",                                                                                                      \
-              Common::LEVEL_ERROR,                                                                                     \
-              (char*)"(%s:%s:%d):" format,                                                                             \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+#define FILENAME( x ) Common::LogFileName( x )
+
+/* 日志宏先判断级别再求值参数，关闭的级别只有一次判断，不会计算log_id、文件名和格式化参数
+ * 低于LOG_MIN_LEVEL的级别在编译期就是常量false，整条语句被编译器去掉
+ */
+#define LOG_IMPL( logId, level, hasCid, cid, format, ... )                                                             \
+  do {                                                                                                                 \
+    if ( ( level ) >= LOG_MIN_LEVEL && LOGGER.IsEnabled( level ) ) {                                                   \
+      static Common::LogSite logSite( level, FILENAME( __FILE__ ), __FUNCTION__, __LINE__, hasCid, format );           \
+      LOGGER.Write( logSite, logId, cid, ##__VA_ARGS__ );                                                              \
+    }                                                                                                                  \
+  } while ( 0 )
+
+#define TRACE( format, ... ) LOG_IMPL( "", Common::LEVEL_TRACE, false, 0, format, ##__VA_ARGS__ )
+
+#define DEBUG( format, ... ) LOG_IMPL( "", Common::LEVEL_DEBUG, false, 0, format, ##__VA_ARGS__ )
+
+#define INFO( format, ... ) LOG_IMPL( "", Common::LEVEL_INFO, false, 0, format, ##__VA_ARGS__ )
+
+#define WARN( format, ... ) LOG_IMPL( "", Common::LEVEL_WARN, false, 0, format, ##__VA_ARGS__ )
+
+#define ERROR( format, ... ) LOG_IMPL( "", Common::LEVEL_ERROR, false, 0, format, ##__VA_ARGS__ )
 
 #define CTX_TRACE( ctx, format, ... )                                                                                  \
-  LOGGER.Log( ctx.log_id(),                                                                                            \
-              Common::LEVEL_TRACE,                                                                                     \
-              (char*)"(%d:%s:%s:%d):" format,                                                                          \
-              MyCoroutine::ScheduleGetRunCid( SCHEDULE ),                                                              \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+  LOG_IMPL( ctx.log_id(), Common::LEVEL_TRACE, true, MyCoroutine::ScheduleGetRunCid( SCHEDULE ), format, ##__VA_ARGS__ )
 
 #define CTX_DEBUG( ctx, format, ... )                                                                                  \
-  LOGGER.Log( ctx.log_id(),                                                                                            \
-              Common::LEVEL_DEBUG,                                                                                     \
-              (char*)"(%d:%s:%s:%d):" format,                                                                          \
-              MyCoroutine::ScheduleGetRunCid( SCHEDULE ),                                                              \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+  LOG_IMPL( ctx.log_id(), Common::LEVEL_DEBUG, true, MyCoroutine::ScheduleGetRunCid( SCHEDULE ), format, ##__VA_ARGS__ )
 
 #define CTX_INFO( ctx, format, ... )                                                                                   \
-  LOGGER.Log( ctx.log_id(),                                                                                            \
-              Common::LEVEL_INFO,                                                                                      \
-              (char*)"(%d:%s:%s:%d):" format,                                                                          \
-              MyCoroutine::ScheduleGetRunCid( SCHEDULE ),                                                              \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+  LOG_IMPL( ctx.log_id(), Common::LEVEL_INFO, true, MyCoroutine::ScheduleGetRunCid( SCHEDULE ), format, ##__VA_ARGS__ )
 
 #define CTX_WARN( ctx, format, ... )                                                                                   \
-  LOGGER.Log( ctx.log_id(),                                                                                            \
-              Common::LEVEL_WARN,                                                                                      \
-              (char*)"(%d:%s:%s:%d):" format,                                                                          \
-              MyCoroutine::ScheduleGetRunCid( SCHEDULE ),                                                              \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+  LOG_IMPL( ctx.log_id(), Common::LEVEL_WARN, true, MyCoroutine::ScheduleGetRunCid( SCHEDULE ), format, ##__VA_ARGS__ )
 
 #define CTX_ERROR( ctx, format, ... )                                                                                  \
-  LOGGER.Log( ctx.log_id(),                                                                                            \
-              Common::LEVEL_ERROR,                                                                                     \
-              (char*)"(%d:%s:%s:%d):" format,                                                                          \
-              MyCoroutine::ScheduleGetRunCid( SCHEDULE ),                                                              \
-              FILENAME( __FILE__ ),                                                                                    \
-              __FUNCTION__,                                                                                            \
-              __LINE__,                                                                                                \
-              ##__VA_ARGS__ )
+  LOG_IMPL( ctx.log_id(), Common::LEVEL_ERROR, true, MyCoroutine::ScheduleGetRunCid( SCHEDULE ), format, ##__VA_ARGS__ )
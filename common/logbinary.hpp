@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace Common {
+constexpr uint32_t LOG_BINARY_SITE_DEFINE = 0;    // 日志位置的定义记录，每个位置在第一次写日志之前写入一次
+constexpr uint32_t LOG_BINARY_TEXT = 1;           // 已经格式化好的文本日志，用于不经过日志宏的Log调用
+constexpr uint32_t LOG_BINARY_FIRST_SITE = 2;     // 日志位置从这个编号开始分配
+constexpr size_t LOG_BINARY_MAX_LOG_ID_LEN = 255; // log_id的长度用一个字节保存，超过时截断
+
+/* 二进制日志的格式
+ * 文件由连续的记录组成，每条记录以LogBinaryHeader开头，所有整数都是本机字节序
+ * 位置定义记录（site_id_为0）：uint32位置编号 + uint8级别 + uint32行号 + uint8是否有协程id + uint8参数个数
+ *   + 每个参数一个字节的LogArgType + 文件名、函数名、格式串（各自是uint32长度 + 内容）
+ * 文本记录（site_id_为1）：uint8 log_id长度 + log_id + uint8级别 + uint32长度 + 日志内容
+ * 日志记录：uint8 log_id长度 + log_id + 按位置定义中的类型依次存放的参数，
+ *   整数和指针统一扩展成8字节，浮点数是double，字符串是uint32长度 + 内容
+ * 位置编号只在进程内唯一，解码时按(pid, 位置编号)查找，同一个pid重新定义时覆盖之前的定义
+ */
+struct LogBinaryHeader
+{
+  uint32_t len_;     // 整条记录的长度，包括头部
+  uint32_t site_id_; // 日志位置的编号
+  int64_t time_us_;  // 微秒时间戳
+  uint32_t pid_;     // 进程id
+  int32_t cid_;      // 协程id，位置定义中没有协程id时忽略
+};
+
+enum LogArgType : uint8_t
+{
+  LOG_ARG_INT = 1,     // 有符号整数，包括char和枚举
+  LOG_ARG_UINT = 2,    // 无符号整数，包括bool
+  LOG_ARG_DOUBLE = 3,  // 浮点数
+  LOG_ARG_STRING = 4,  // C风格的字符串
+  LOG_ARG_POINTER = 5, // 其它指针，只记录地址
+};
+
+// 参数的类型在编译期确定，和printf一样只支持标量和C风格的字符串
+template <typename T>
+constexpr LogArgType LogBinaryArgType()
+{
+  using Type = std::decay_t<T>;
+  if constexpr ( std::is_same_v<Type, bool> || std::is_unsigned_v<Type> ) {
+    return LOG_ARG_UINT;
+  } else if constexpr ( std::is_integral_v<Type> || std::is_enum_v<Type> ) {
+    return LOG_ARG_INT;
+  } else if constexpr ( std::is_floating_point_v<Type> ) {
+    return LOG_ARG_DOUBLE;
+  } else if constexpr ( std::is_same_v<Type, char*> || std::is_same_v<Type, const char*> ) {
+    return LOG_ARG_STRING;
+  } else {
+    static_assert( std::is_pointer_v<Type>, "unsupported log argument type" );
+    return LOG_ARG_POINTER;
+  }
+}
+
+class LogBinary
+{
+public:
+  template <typename T>
+  static void AppendRaw( std::string& out, T value )
+  {
+    out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) );
+  }
+
+  static void AppendString( std::string& out, std::string_view str )
+  {
+    AppendRaw( out, static_cast<uint32_t>( str.size() ) );
+    out.append( str );
+  }
+
+  // 按LogBinaryArgType的类型追加一个参数，只拷贝原始字节，不做任何格式化
+  template <typename T>
+  static void AppendArg( std::string& out, const T& arg )
+  {
+    constexpr LogArgType type = LogBinaryArgType<T>();
+    if constexpr ( LOG_ARG_UINT == type ) {
+      AppendRaw( out, static_cast<uint64_t>( arg ) );
+    } else if constexpr ( LOG_ARG_INT == type ) {
+      AppendRaw( out, static_cast<int64_t>( arg ) );
+    } else if constexpr ( LOG_ARG_DOUBLE == type ) {
+      AppendRaw( out, static_cast<double>( arg ) );
+    } else if constexpr ( LOG_ARG_STRING == type ) {
+      const char* str = arg;
+      AppendString( out, nullptr == str ? "(null)" : str ); // 和glibc的printf保持一致
+    } else {
+      AppendRaw( out, reinterpret_cast<uint64_t>( arg ) );
+    }
+  }
+
+  // 读取时越界返回false，data和len指向剩余的数据
+  template <typename T>
+  static bool ReadRaw( const char*& data, size_t& len, T& value )
+  {
+    if ( len < sizeof( value ) ) {
+      return false;
+    }
+    memcpy( &value, data, sizeof( value ) );
+    data += sizeof( value );
+    len -= sizeof( value );
+    return true;
+  }
+
+  static bool ReadString( const char*& data, size_t& len, std::string_view& str )
+  {
+    uint32_t strLen = 0;
+    if ( !ReadRaw( data, len, strLen ) || len < strLen ) {
+      return false;
+    }
+    str = std::string_view( data, strLen );
+    data += strLen;
+    len -= strLen;
+    return true;
+  }
+};
+
+} // namespace Common
\ No newline at end of file
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace Common {
+constexpr size_t LOG_ID_LEN = 16;           // log_id的长度，16个base32字符，共80位
+constexpr uint32_t LOG_ID_TIME_BITS = 25;   // 秒数，按2^25取模，约388天回绕一次
+constexpr uint32_t LOG_ID_NODE_BITS = 30;   // 节点，机器编号和完整的pid
+constexpr uint32_t LOG_ID_PID_BITS = 22;    // linux的pid不超过2^22（PID_MAX_LIMIT），剩下的8位是机器编号
+constexpr uint32_t LOG_ID_THREAD_BITS = 10; // 线程序号，同时存活的线程最多1024个
+constexpr uint32_t LOG_ID_SEQ_BITS = 15;    // 线程内每秒的序号，每秒最多32768个
+// Crockford base32，去掉了容易混淆的i、l、o、u
+constexpr char LOG_ID_ALPHABET[] = "0123456789abcdefghjkmnpqrstvwxyz";
+
+/* log_id生成器，log_id由 秒数 + 节点 + 线程序号 + 线程内序号 组成，按时间有序
+ * 每个线程只修改自己的计数器，生成过程不加锁、不分配内存
+ * 一秒内的序号用完之后借用下一秒，同一个线程生成的log_id单调递增
+ * 唯一性范围：388天之内，机器编号不同的机器之间不重复。机器编号默认是完整ip（没有eth0时为主机名）的8位哈希，
+ * 不同机器的哈希可能相同，需要严格不重复时通过SetHostId为每台机器分配不同的编号
+ * 线程退出时连同计数器一起归还线程序号，新线程接着使用，不会和退出的线程重复
+ */
+class LogId
+{
+public:
+  // 向out写入LOG_ID_LEN个字符，不以'\0'结尾
+  static void Gen( char* out )
+  {
+    thread_local ThreadState threadState;
+    State& state = threadState.state_;
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME_COARSE, &now );
+    uint64_t sec = static_cast<uint64_t>( now.tv_sec );
+    if ( sec > state.sec_ ) {
+      state.sec_ = sec;
+      state.seq_ = 0;
+    } else if ( state.seq_ >> LOG_ID_SEQ_BITS ) {
+      ++state.sec_;
+      state.seq_ = 0;
+    }
+
+    uint64_t high = ( state.sec_ & mask( LOG_ID_TIME_BITS ) ) << LOG_ID_NODE_BITS | node();
+    uint64_t low = static_cast<uint64_t>( state.thread_index_ ) << LOG_ID_SEQ_BITS | state.seq_++;
+    encode( high, out, ( LOG_ID_TIME_BITS + LOG_ID_NODE_BITS ) / 5 );
+    encode( low, out + ( LOG_ID_TIME_BITS + LOG_ID_NODE_BITS ) / 5, ( LOG_ID_THREAD_BITS + LOG_ID_SEQ_BITS ) / 5 );
+  }
+
+  static std::string Gen()
+  {
+    std::string logId( LOG_ID_LEN, '\0' );
+    Gen( logId.data() );
+    return logId;
+  }
+
+  // 指定机器编号（0-255），需要在第一次生成log_id之前调用，之后调用返回false
+  static bool SetHostId( uint8_t hostId )
+  {
+    if ( nodeReady().load( std::memory_order_acquire ) ) {
+      return false;
+    }
+    configHostId().store( hostId, std::memory_order_release );
+    return true;
+  }
+
+private:
+  static_assert( ( LOG_ID_TIME_BITS + LOG_ID_NODE_BITS ) % 5 == 0 );
+  static_assert( ( LOG_ID_THREAD_BITS + LOG_ID_SEQ_BITS ) % 5 == 0 );
+  static_assert( ( LOG_ID_TIME_BITS + LOG_ID_NODE_BITS + LOG_ID_THREAD_BITS + LOG_ID_SEQ_BITS ) == LOG_ID_LEN * 5 );
+
+  struct State
+  {
+    uint64_t sec_;          // 当前使用的秒数，序号用完时会超前于真实时间
+    uint64_t seq_;          // 当前秒内的下一个序号
+    uint32_t thread_index_; // 线程序号
+  };
+
+  // 线程序号的分配表，只在线程创建和退出时加锁
+  struct Registry
+  {
+    std::mutex mutex_;
+    std::vector<State> free_; // 已经退出的线程归还的状态
+    uint32_t next_ { 0 };     // 下一个没有分配过的线程序号
+  };
+
+  // 线程第一次生成log_id时分配序号，退出时归还
+  struct ThreadState
+  {
+    ThreadState() : state_( acquire() ) {}
+    ~ThreadState() { release( state_ ); }
+    State state_;
+  };
+
+  static constexpr uint64_t mask( uint32_t bits ) { return ( uint64_t( 1 ) << bits ) - 1; }
+
+  static Registry& registry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  static State acquire()
+  {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock( reg.mutex_ );
+    if ( !reg.free_.empty() ) {
+      State state = reg.free_.back();
+      reg.free_.pop_back();
+      return state;
+    }
+    assert( reg.next_ <= mask( LOG_ID_THREAD_BITS ) ); // 同时存活的线程超过上限，log_id会重复
+    return State { 0, 0, reg.next_++ & static_cast<uint32_t>( mask( LOG_ID_THREAD_BITS ) ) };
+  }
+
+  static void release( const State& state )
+  {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock( reg.mutex_ );
+    reg.free_.push_back( state );
+  }
+
+  // 每5位编码成一个字符，高位在前，保证字符串的顺序和数值的顺序一致
+  static void encode( uint64_t value, char* out, size_t len )
+  {
+    for ( size_t i = len; i > 0; --i ) {
+      out[i - 1] = LOG_ID_ALPHABET[value & 0x1f];
+      value >>= 5;
+    }
+  }
+
+  // SetHostId设置的机器编号，-1表示没有设置
+  static std::atomic<int32_t>& configHostId()
+  {
+    static std::atomic<int32_t> hostId { -1 };
+    return hostId;
+  }
+
+  static std::atomic<bool>& nodeReady()
+  {
+    static std::atomic<bool> ready { false };
+    return ready;
+  }
+
+  // 完整ip的FNV-1a哈希折叠成8位，没有eth0时GetIpStr返回127.0.0.1，改用主机名
+  static uint64_t hostHash()
+  {
+    std::string host = Utils::GetIpStr( "eth0" );
+    if ( host.empty() || "127000000001" == host ) {
+      char name[256] { 0 };
+      gethostname( name, sizeof( name ) - 1 );
+      host = name;
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    for ( char c : host ) {
+      hash = ( hash ^ static_cast<uint8_t>( c ) ) * 1099511628211ULL;
+    }
+    for ( uint32_t bits = 32; bits >= LOG_ID_NODE_BITS - LOG_ID_PID_BITS; bits /= 2 ) {
+      hash ^= hash >> bits;
+    }
+    return hash;
+  }
+
+  // 机器编号区分机器，pid区分同一台机器上的进程，只在第一次调用时计算
+  static uint64_t node()
+  {
+    static const uint64_t node = []() {
+      nodeReady().store( true, std::memory_order_release );
+      int32_t hostId = configHostId().load( std::memory_order_acquire );
+      uint64_t host = hostId >= 0 ? static_cast<uint64_t>( hostId ) : hostHash();
+      return ( host & mask( LOG_ID_NODE_BITS - LOG_ID_PID_BITS ) ) << LOG_ID_PID_BITS
+             | ( static_cast<uint64_t>( getpid() ) & mask( LOG_ID_PID_BITS ) );
+    }();
+    return node;
+  }
+};
+
+} // namespace Common
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 namespace Common {
@@ -33,6 +34,40 @@ public:
     return len;
   }
 
+  // 分散写，处理部分写入的情况，iov中的内容会被修改
+  ssize_t Writev( struct iovec* iov, int iovCnt )
+  {
+    ssize_t len = 0;
+    for ( int i = 0; i < iovCnt; ++i ) {
+      len += iov[i].iov_len;
+    }
+
+    ssize_t total = len;
+    while ( total > 0 ) {
+      ssize_t ret = writev( fd_, iov, iovCnt );
+      if ( ret <= 0 ) {
+        if ( 0 == ret || RestartAgain( errno ) ) {
+          continue;
+        }
+        return -1;
+      }
+
+      total -= ret;
+      // 跳过已经写完的iov，并调整写了一部分的iov
+      while ( iovCnt > 0 && static_cast<size_t>( ret ) >= iov->iov_len ) {
+        ret -= iov->iov_len;
+        ++iov;
+        --iovCnt;
+      }
+      if ( iovCnt > 0 ) {
+        iov->iov_base = static_cast<uint8_t*>( iov->iov_base ) + ret;
+        iov->iov_len -= ret;
+      }
+    }
+
+    return len;
+  }
+
   ssize_t Read( uint8_t* data, size_t len )
   {
     ssize_t total = len;
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <sys/time.h>
+#include <time.h>
 
+#include <cstdio>
 #include <string>
+#include <string_view>
 
 namespace Common {
 class TimeStat
@@ -42,8 +45,10 @@ public:
     struct timeval curTime;
     char temp[100] = { 0 };
     char timeStr[100] = { 0 };
+    struct tm tmTime;
     gettimeofday( &curTime, NULL );
-    strftime( temp, 99, format, localtime( &curTime.tv_sec ) );
+    // localtime返回的是全局的静态缓冲区，多线程下需要用localtime_r
+    strftime( temp, 99, format, localtime_r( &curTime.tv_sec, &tmTime ) );
     if ( hasUSec ) {
       snprintf( timeStr, 99, "%s:%06ld", temp, curTime.tv_usec );
       return timeStr;
@@ -53,4 +58,62 @@ public:
   }
 };
 
+/* 线程私有的时间戳缓存，用于写日志这类高频场景
+ * 使用粗粒度的时钟（精度为一个时钟节拍，通常是1~4ms），秒数不变时只改写微秒部分，
+ * 每秒最多调用一次localtime_r和strftime。返回的视图在当前线程下一次调用之前有效
+ */
+class TimeCache
+{
+public:
+  // 格式为"%F %T:微秒"，和GetTimeStr( "%F %T", true )的输出一致
+  static std::string_view LogTimeStr()
+  {
+    Cache& cache = refresh();
+    char* usec = cache.log_time_ + LOG_TIME_SEC_LEN + 1;
+    long value = cache.usec_;
+    for ( int i = 5; i >= 0; --i ) {
+      usec[i] = static_cast<char>( '0' + value % 10 );
+      value /= 10;
+    }
+    return { cache.log_time_, LOG_TIME_LEN };
+  }
+
+  // 格式为"%Y%m%d%H%M%S"，精确到秒
+  static std::string_view SecondStr()
+  {
+    Cache& cache = refresh();
+    return { cache.second_, SECOND_LEN };
+  }
+
+private:
+  static constexpr size_t LOG_TIME_SEC_LEN = 19;                  // "YYYY-MM-DD HH:MM:SS"的长度
+  static constexpr size_t LOG_TIME_LEN = LOG_TIME_SEC_LEN + 1 + 6; // 加上":"和6位微秒
+  static constexpr size_t SECOND_LEN = 14;                        // "YYYYMMDDHHMMSS"的长度
+
+  struct Cache
+  {
+    time_t sec_ { -1 };               // 缓存对应的秒数
+    long usec_ { 0 };                 // 最近一次取到的微秒数
+    char log_time_[LOG_TIME_LEN + 1]; // 秒之前的部分按秒缓存，微秒部分每次改写
+    char second_[SECOND_LEN + 1];     // 只精确到秒的紧凑格式
+  };
+
+  static Cache& refresh()
+  {
+    thread_local Cache cache;
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME_COARSE, &now );
+    cache.usec_ = now.tv_nsec / 1000;
+    if ( now.tv_sec != cache.sec_ ) { // 跨秒了才重新格式化
+      struct tm tmTime;
+      localtime_r( &now.tv_sec, &tmTime );
+      strftime( cache.log_time_, sizeof( cache.log_time_ ), "%F %T", &tmTime );
+      cache.log_time_[LOG_TIME_SEC_LEN] = ':';
+      strftime( cache.second_, sizeof( cache.second_ ), "%Y%m%d%H%M%S", &tmTime );
+      cache.sec_ = now.tv_sec;
+    }
+    return cache;
+  }
+};
+
 } // namespace Common
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace Protocol {
+constexpr uint32_t POOL_MIN_SHIFT = 6;                   // 最小的尺寸等级为64字节
+constexpr uint32_t POOL_MAX_SHIFT = 25;                  // 最大的尺寸等级为32M字节，更大的直接使用malloc
+constexpr size_t POOL_MAX_FREE_COUNT = 256;              // 每个尺寸等级最多缓存的空闲块数
+constexpr size_t POOL_MAX_FREE_BYTES = 64 * 1024 * 1024; // 每个线程最多缓存的空闲内存
+
+// 线程私有的按尺寸分级的缓冲区池，所有Packet共用，减少连接频繁创建销毁和大消息带来的malloc开销
+class BufferPool
+{
+public:
+  static BufferPool& Instance()
+  {
+    static thread_local BufferPool pool;
+    return pool;
+  }
+
+  ~BufferPool()
+  {
+    destroyed_ = true;
+    for ( auto& freeList : free_lists_ ) {
+      for ( auto* data : freeList ) {
+        free( data );
+      }
+    }
+  }
+
+  // 申请至少len字节的内存，cap返回实际可用的容量
+  static uint8_t* Get( size_t len, size_t& cap )
+  {
+    if ( destroyed_ ) { // 线程退出阶段，池已经析构，直接使用malloc
+      return mallocOrThrow( len, cap );
+    }
+    return Instance().get( len, cap );
+  }
+
+  // 归还内存，cap必须是Get返回的容量
+  static void Put( uint8_t* data, size_t cap )
+  {
+    if ( nullptr == data ) {
+      return;
+    }
+    if ( destroyed_ ) {
+      free( data );
+      return;
+    }
+    Instance().put( data, cap );
+  }
+
+  uint64_t Hit() const { return hit_; }   // 从池中取到内存的次数
+  uint64_t Miss() const { return miss_; } // 需要调用malloc的次数
+  size_t FreeBytes() const { return free_bytes_; }
+
+private:
+  BufferPool() = default;
+
+  uint8_t* get( size_t len, size_t& cap )
+  {
+    uint32_t shift = sizeShift( len );
+    if ( shift > POOL_MAX_SHIFT ) {
+      ++miss_;
+      return mallocOrThrow( len, cap );
+    }
+
+    cap = static_cast<size_t>( 1 ) << shift;
+    auto& freeList = free_lists_[shift - POOL_MIN_SHIFT];
+    if ( freeList.empty() ) {
+      ++miss_;
+      return mallocOrThrow( cap, cap );
+    }
+
+    ++hit_;
+    uint8_t* data = freeList.back();
+    freeList.pop_back();
+    free_bytes_ -= cap;
+    return data;
+  }
+
+  void put( uint8_t* data, size_t cap )
+  {
+    uint32_t shift = sizeShift( cap );
+    // 不是池中的尺寸等级，或者缓存已经达到上限，直接释放
+    if ( shift > POOL_MAX_SHIFT || ( static_cast<size_t>( 1 ) << shift ) != cap ) {
+      free( data );
+      return;
+    }
+    auto& freeList = free_lists_[shift - POOL_MIN_SHIFT];
+    if ( freeList.size() >= POOL_MAX_FREE_COUNT || free_bytes_ + cap > POOL_MAX_FREE_BYTES ) {
+      free( data );
+      return;
+    }
+    freeList.push_back( data );
+    free_bytes_ += cap;
+  }
+
+  // 计算能容纳len字节的尺寸等级
+  static uint32_t sizeShift( size_t len )
+  {
+    uint32_t shift = POOL_MIN_SHIFT;
+    while ( shift <= POOL_MAX_SHIFT && ( static_cast<size_t>( 1 ) << shift ) < len ) {
+      ++shift;
+    }
+    return shift;
+  }
+
+  static uint8_t* mallocOrThrow( size_t len, size_t& cap )
+  {
+    auto* data = static_cast<uint8_t*>( malloc( len ) );
+    if ( nullptr == data ) {
+      throw std::bad_alloc();
+    }
+    cap = len;
+    return data;
+  }
+
+  static inline thread_local bool destroyed_ { false }; // 线程退出时池会先于部分Packet析构
+  std::vector<uint8_t*> free_lists_[POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1]; // 每个尺寸等级的空闲块
+  size_t free_bytes_ { 0 };                                               // 当前缓存的空闲内存
+  uint64_t hit_ { 0 };
+  uint64_t miss_ { 0 };
+};
+} // namespace Protocol
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+namespace Protocol {
+// 字节流中分隔符的查找，支持AVX2和SSE2一次比较32/16个字节，不支持时退化为逐字节查找
+class ByteScan
+{
+public:
+  // 查找字符c第一次出现的位置，找不到返回len
+  static size_t FindChar( const uint8_t* data, size_t len, uint8_t c )
+  {
+    size_t i = 0;
+#if defined( __AVX2__ )
+    const __m256i target32 = _mm256_set1_epi8( static_cast<char>( c ) );
+    for ( ; i + 32 <= len; i += 32 ) {
+      __m256i chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + i ) );
+      uint32_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, target32 ) ) );
+      if ( mask != 0 ) {
+        return i + __builtin_ctz( mask );
+      }
+    }
+#endif
+#if defined( __SSE2__ )
+    const __m128i target16 = _mm_set1_epi8( static_cast<char>( c ) );
+    for ( ; i + 16 <= len; i += 16 ) {
+      __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i ) );
+      uint32_t mask = static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, target16 ) ) );
+      if ( mask != 0 ) {
+        return i + __builtin_ctz( mask );
+      }
+    }
+#endif
+    for ( ; i < len; ++i ) {
+      if ( data[i] == c ) {
+        return i;
+      }
+    }
+    return len;
+  }
+
+  // 查找"\r\n"第一次出现的位置（指向'\r'），找不到返回len
+  static size_t FindCrlf( const uint8_t* data, size_t len )
+  {
+    size_t pos = 0;
+    while ( pos < len ) {
+      size_t cr = FindChar( data + pos, len - pos, '\r' );
+      pos += cr;
+      if ( pos + 1 >= len ) {
+        return len;
+      }
+      if ( data[pos + 1] == '\n' ) {
+        return pos;
+      }
+      ++pos;
+    }
+    return len;
+  }
+
+  // 去掉[begin, end)区间首尾的空格
+  static void Trim( const uint8_t*& begin, const uint8_t*& end )
+  {
+    while ( begin < end && *begin == ' ' ) {
+      ++begin;
+    }
+    while ( end > begin && *( end - 1 ) == ' ' ) {
+      --end;
+    }
+  }
+};
+} // namespace Protocol
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <utility>
+
 #include "packet.hpp"
 
 namespace Protocol {
@@ -10,6 +12,7 @@ enum CodecType
   HTTP = 1,
   MY_SVR = 2,
   RESP = 3,
+  HTTP2 = 4,
 };
 
 // 协议编解码基类
@@ -23,6 +26,10 @@ public:
   virtual bool Encode( void* msg, Packet& pkt ) = 0;
   virtual bool Decode( size_t len ) = 0;
   virtual CodecType Type() = 0;
+  // 接管其它codec已经读取到的数据，之后调用Decode( 0 )解析
+  void TakeOver( Packet& pkt ) { pkt_ = std::move( pkt ); }
+  // codec自身需要发送的数据（例如HTTP/2的控制帧），Decode之后调用，没有数据时返回false
+  virtual bool TakeOutput( Packet& /* pkt */ ) { return false; }
 
 protected:
   Packet pkt_;
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <snappy.h>
+
+#include <cstring>
+
+#include "packet.hpp"
+
+#ifdef MY_SVR_USE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef MY_SVR_USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Protocol {
+// 压缩算法类型，取值存放在协议头flag_的第4、5位
+enum CompressType
+{
+  COMPRESS_SNAPPY = 0, // snappy压缩，取值为0是为了兼容旧版本协议（旧版本协议固定使用snappy压缩）
+  COMPRESS_NONE = 1,   // 不压缩
+  COMPRESS_LZ4 = 2,    // lz4压缩，需要定义MY_SVR_USE_LZ4
+  COMPRESS_ZSTD = 3,   // zstd压缩，需要定义MY_SVR_USE_ZSTD
+};
+
+constexpr uint32_t LZ4_LEN_PREFIX = 4; // lz4的block格式不带原始长度，需要额外4个字节存放
+constexpr int ZSTD_COMPRESS_LEVEL = 1; // zstd的压缩级别，优先考虑压缩速度
+
+// 压缩和解压的统一入口，根据压缩算法类型进行分发
+class Compressor
+{
+public:
+  // 当前编译的版本是否支持该压缩算法
+  static bool IsSupport( uint8_t type )
+  {
+    if ( COMPRESS_SNAPPY == type || COMPRESS_NONE == type ) {
+      return true;
+    }
+#ifdef MY_SVR_USE_LZ4
+    if ( COMPRESS_LZ4 == type ) {
+      return true;
+    }
+#endif
+#ifdef MY_SVR_USE_ZSTD
+    if ( COMPRESS_ZSTD == type ) {
+      return true;
+    }
+#endif
+    return false;
+  }
+
+  // 直接压缩到目标缓冲区中，避免中间的std::string拷贝
+  static bool Compress( uint8_t type, const uint8_t* data, size_t len, Packet& out )
+  {
+    if ( COMPRESS_NONE == type ) {
+      out.Alloc( len );
+      if ( len > 0 ) {
+        memcpy( out.Data(), data, len );
+      }
+      out.UpdateUseLen( len );
+      return true;
+    }
+
+    if ( COMPRESS_SNAPPY == type ) {
+      out.Alloc( snappy::MaxCompressedLength( len ) );
+      size_t compressLen = 0;
+      snappy::RawCompress(
+        reinterpret_cast<const char*>( data ), len, reinterpret_cast<char*>( out.DataRaw() ), &compressLen );
+      out.UpdateUseLen( compressLen );
+      return true;
+    }
+
+#ifdef MY_SVR_USE_LZ4
+    if ( COMPRESS_LZ4 == type ) {
+      int maxLen = LZ4_compressBound( static_cast<int>( len ) );
+      out.Alloc( LZ4_LEN_PREFIX + maxLen );
+      uint32_t rawLen = htonl( static_cast<uint32_t>( len ) );
+      memcpy( out.DataRaw(), &rawLen, LZ4_LEN_PREFIX );
+      int compressLen = LZ4_compress_default( reinterpret_cast<const char*>( data ),
+                                              reinterpret_cast<char*>( out.DataRaw() + LZ4_LEN_PREFIX ),
+                                              static_cast<int>( len ),
+                                              maxLen );
+      if ( compressLen <= 0 && len > 0 ) {
+        return false;
+      }
+      out.UpdateUseLen( LZ4_LEN_PREFIX + compressLen );
+      return true;
+    }
+#endif
+
+#ifdef MY_SVR_USE_ZSTD
+    if ( COMPRESS_ZSTD == type ) {
+      out.Alloc( ZSTD_compressBound( len ) );
+      size_t compressLen = ZSTD_compress( out.DataRaw(), out.Len(), data, len, ZSTD_COMPRESS_LEVEL );
+      if ( ZSTD_isError( compressLen ) ) {
+        return false;
+      }
+      out.UpdateUseLen( compressLen );
+      return true;
+    }
+#endif
+
+    return false;
+  }
+
+  // 先读取解压后的长度并预分配空间，再直接解压到目标缓冲区中
+  static bool Uncompress( uint8_t type, const uint8_t* data, size_t len, size_t maxLen, Packet& out )
+  {
+    size_t uncompressLen = 0;
+    if ( !uncompressedLength( type, data, len, uncompressLen ) ) {
+      return false;
+    }
+    if ( uncompressLen > maxLen ) {
+      return false;
+    }
+
+    out.Alloc( uncompressLen );
+    if ( COMPRESS_NONE == type ) {
+      if ( len > 0 ) {
+        memcpy( out.Data(), data, len );
+      }
+    } else if ( COMPRESS_SNAPPY == type ) {
+      if ( !snappy::RawUncompress(
+             reinterpret_cast<const char*>( data ), len, reinterpret_cast<char*>( out.Data() ) ) ) {
+        return false;
+      }
+    }
+#ifdef MY_SVR_USE_LZ4
+    else if ( COMPRESS_LZ4 == type ) {
+      int ret = LZ4_decompress_safe( reinterpret_cast<const char*>( data + LZ4_LEN_PREFIX ),
+                                     reinterpret_cast<char*>( out.Data() ),
+                                     static_cast<int>( len - LZ4_LEN_PREFIX ),
+                                     static_cast<int>( uncompressLen ) );
+      if ( ret < 0 || static_cast<size_t>( ret ) != uncompressLen ) {
+        return false;
+      }
+    }
+#endif
+#ifdef MY_SVR_USE_ZSTD
+    else if ( COMPRESS_ZSTD == type ) {
+      size_t ret = ZSTD_decompress( out.Data(), uncompressLen, data, len );
+      if ( ZSTD_isError( ret ) || ret != uncompressLen ) {
+        return false;
+      }
+    }
+#endif
+    else {
+      return false;
+    }
+    out.UpdateUseLen( uncompressLen );
+    return true;
+  }
+
+private:
+  static bool uncompressedLength( uint8_t type, const uint8_t* data, size_t len, size_t& uncompressLen )
+  {
+    if ( COMPRESS_NONE == type ) {
+      uncompressLen = len;
+      return true;
+    }
+
+    if ( COMPRESS_SNAPPY == type ) {
+      return snappy::GetUncompressedLength( reinterpret_cast<const char*>( data ), len, &uncompressLen );
+    }
+
+#ifdef MY_SVR_USE_LZ4
+    if ( COMPRESS_LZ4 == type ) {
+      if ( len < LZ4_LEN_PREFIX ) {
+        return false;
+      }
+      uint32_t rawLen = 0;
+      memcpy( &rawLen, data, LZ4_LEN_PREFIX );
+      uncompressLen = ntohl( rawLen );
+      return true;
+    }
+#endif
+
+#ifdef MY_SVR_USE_ZSTD
+    if ( COMPRESS_ZSTD == type ) {
+      unsigned long long contentSize = ZSTD_getFrameContentSize( data, len );
+      if ( ZSTD_CONTENTSIZE_ERROR == contentSize || ZSTD_CONTENTSIZE_UNKNOWN == contentSize ) {
+        return false;
+      }
+      uncompressLen = static_cast<size_t>( contentSize );
+      return true;
+    }
+#endif
+
+    return false;
+  }
+};
+} // namespace Protocol
\ No newline at end of file
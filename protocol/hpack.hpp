@@ -0,0 +1,487 @@
+#pragma once
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "packet.hpp"
+
+namespace Protocol {
+constexpr uint32_t HPACK_STATIC_TABLE_LEN = 61;      // 静态表的条目数，动态表的索引从62开始
+constexpr uint32_t HPACK_ENTRY_OVERHEAD = 32;        // 动态表中每个条目额外计算的长度
+constexpr uint32_t HPACK_DEFAULT_TABLE_SIZE = 4096;  // 动态表默认的最大长度
+constexpr uint32_t HPACK_HUFFMAN_SYMBOL_COUNT = 256; // huffman编码的符号个数，不包括EOS
+constexpr uint32_t HPACK_HUFFMAN_EOS = 256;          // EOS符号，只能出现在填充中
+constexpr uint32_t HPACK_HUFFMAN_EOS_CODE = 0x3fffffff;
+constexpr uint8_t HPACK_HUFFMAN_EOS_LEN = 30;
+constexpr uint32_t HPACK_MAX_INT_LEN = 5; // 整数编码的最大续传字节数，超过之后的值没有意义
+
+struct HpackEntry
+{
+  std::string_view name_;
+  std::string_view value_;
+};
+
+// RFC 7541附录A的静态表和附录B的huffman编码表
+constexpr uint32_t HPACK_HUFFMAN_CODES[HPACK_HUFFMAN_SYMBOL_COUNT] = {
+  0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+  0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+  0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+  0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+  0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+  0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+  0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+  0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+  0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+  0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+  0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+  0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+  0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+  0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+  0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+  0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+  0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+  0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+  0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+  0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+  0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+  0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+  0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+  0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+  0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+  0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+  0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+  0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+  0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+  0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+  0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+  0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+constexpr uint8_t HPACK_HUFFMAN_CODE_LENS[HPACK_HUFFMAN_SYMBOL_COUNT] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+  5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+  13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+  15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+  6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+constexpr HpackEntry HPACK_STATIC_TABLE[HPACK_STATIC_TABLE_LEN] = {
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" },
+};
+
+/* HPACK解码，动态表在同一个连接的所有header block之间共享，所以每个连接一个解码器
+ * 没有经过huffman编码的字面值直接返回指向输入的视图，huffman编码的字面值解码到内部的缓冲区中
+ */
+class HpackDecoder
+{
+public:
+  // 通过SETTINGS_HEADER_TABLE_SIZE通告给对端的动态表上限
+  void SetMaxTableSize( size_t maxTableSize ) { max_table_size_ = maxTableSize; }
+
+  /* 解码一个完整的header block，每解码出一个header调用一次handler( name, value )
+   * name和value只在回调期间有效，handler返回false时停止解码并返回false
+   */
+  template <typename Handler>
+  bool Decode( const uint8_t* data, size_t len, Handler&& handler )
+  {
+    const uint8_t* end = data + len;
+    while ( data < end ) {
+      uint8_t first = *data;
+      if ( first & 0x80 ) { // 1xxxxxxx，索引
+        uint64_t index = 0;
+        if ( !decodeInt( data, end, 7, index ) ) {
+          return false;
+        }
+        const HpackEntry* entry = lookup( index );
+        if ( nullptr == entry || !handler( entry->name_, entry->value_ ) ) {
+          return false;
+        }
+        continue;
+      }
+
+      if ( ( first & 0xe0 ) == 0x20 ) { // 001xxxxx，动态表长度更新
+        uint64_t size = 0;
+        if ( !decodeInt( data, end, 5, size ) || size > max_table_size_ ) {
+          return false;
+        }
+        table_size_limit_ = size;
+        evict( 0 );
+        continue;
+      }
+
+      // 01xxxxxx增量索引，0000xxxx不索引，0001xxxx永不索引，区别只在于是否加入动态表
+      bool indexing = ( first & 0xc0 ) == 0x40;
+      uint64_t index = 0;
+      if ( !decodeInt( data, end, indexing ? 6 : 4, index ) ) {
+        return false;
+      }
+      std::string_view name;
+      if ( index > 0 ) {
+        const HpackEntry* entry = lookup( index );
+        if ( nullptr == entry ) {
+          return false;
+        }
+        name = entry->name_;
+      } else if ( !decodeString( data, end, name_buf_, name ) ) {
+        return false;
+      }
+      std::string_view value;
+      if ( !decodeString( data, end, value_buf_, value ) ) {
+        return false;
+      }
+      if ( !indexing ) {
+        if ( !handler( name, value ) ) {
+          return false;
+        }
+        continue;
+      }
+
+      // 先拷贝再插入，name可能引用的是即将被淘汰的条目
+      if ( insert( std::string( name ), std::string( value ) ) ) {
+        name = entries_.front().first;
+        value = entries_.front().second;
+      } else {
+        name = name_buf_;
+        value = value_buf_;
+      }
+      if ( !handler( name, value ) ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  const HpackEntry* lookup( uint64_t index )
+  {
+    if ( 0 == index ) {
+      return nullptr;
+    }
+    if ( index <= HPACK_STATIC_TABLE_LEN ) {
+      return &HPACK_STATIC_TABLE[index - 1];
+    }
+    index -= HPACK_STATIC_TABLE_LEN + 1;
+    if ( index >= entries_.size() ) {
+      return nullptr;
+    }
+    lookup_entry_ = { entries_[index].first, entries_[index].second };
+    return &lookup_entry_;
+  }
+
+  // 超过上限的条目不会加入动态表，但是会清空动态表，此时条目保存在name_buf_和value_buf_中，返回false
+  bool insert( std::string name, std::string value )
+  {
+    size_t entrySize = name.size() + value.size() + HPACK_ENTRY_OVERHEAD;
+    evict( entrySize );
+    if ( entrySize > table_size_limit_ ) {
+      name_buf_ = std::move( name );
+      value_buf_ = std::move( value );
+      return false;
+    }
+    entries_.emplace_front( std::move( name ), std::move( value ) );
+    table_size_ += entrySize;
+    return true;
+  }
+
+  // 淘汰最旧的条目，直到能放下reserve长度的新条目
+  void evict( size_t reserve )
+  {
+    while ( !entries_.empty() && table_size_ + reserve > table_size_limit_ ) {
+      table_size_ -= entries_.back().first.size() + entries_.back().second.size() + HPACK_ENTRY_OVERHEAD;
+      entries_.pop_back();
+    }
+  }
+
+  // 带prefixBits位前缀的整数
+  static bool decodeInt( const uint8_t*& data, const uint8_t* end, uint32_t prefixBits, uint64_t& value )
+  {
+    if ( data >= end ) {
+      return false;
+    }
+    uint64_t mask = ( 1u << prefixBits ) - 1;
+    value = *data++ & mask;
+    if ( value < mask ) {
+      return true;
+    }
+    for ( uint32_t shift = 0; shift < HPACK_MAX_INT_LEN * 7; shift += 7 ) {
+      if ( data >= end ) {
+        return false;
+      }
+      uint8_t byte = *data++;
+      value += static_cast<uint64_t>( byte & 0x7f ) << shift;
+      if ( 0 == ( byte & 0x80 ) ) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool decodeString( const uint8_t*& data, const uint8_t* end, std::string& buf, std::string_view& str )
+  {
+    if ( data >= end ) {
+      return false;
+    }
+    bool huffman = *data & 0x80;
+    uint64_t len = 0;
+    if ( !decodeInt( data, end, 7, len ) || len > static_cast<uint64_t>( end - data ) ) {
+      return false;
+    }
+    if ( !huffman ) {
+      str = std::string_view( reinterpret_cast<const char*>( data ), len );
+      data += len;
+      return true;
+    }
+    if ( !decodeHuffman( data, len, buf ) ) {
+      return false;
+    }
+    data += len;
+    str = buf;
+    return true;
+  }
+
+  static bool decodeHuffman( const uint8_t* data, size_t len, std::string& out )
+  {
+    const HuffmanTree& tree = huffmanTree();
+    out.clear();
+    int32_t node = 0;
+    uint32_t padBits = 0; // 最后一个符号之后的比特数，只能是不超过7位的EOS前缀（全1）
+    bool allOnes = true;
+    for ( size_t i = 0; i < len; ++i ) {
+      for ( int32_t bit = 7; bit >= 0; --bit ) {
+        uint32_t b = ( data[i] >> bit ) & 1;
+        node = tree.next_[node][b];
+        if ( node <= 0 ) {
+          return false;
+        }
+        ++padBits;
+        allOnes = allOnes && b;
+        int32_t symbol = tree.symbol_[node];
+        if ( symbol < 0 ) {
+          continue;
+        }
+        if ( HPACK_HUFFMAN_EOS == static_cast<uint32_t>( symbol ) ) {
+          return false;
+        }
+        out.push_back( static_cast<char>( symbol ) );
+        node = 0;
+        padBits = 0;
+        allOnes = true;
+      }
+    }
+    return padBits <= 7 && allOnes;
+  }
+
+  // huffman解码用的二叉树，节点0是根节点，next_为0表示没有子节点
+  struct HuffmanTree
+  {
+    int32_t next_[( HPACK_HUFFMAN_SYMBOL_COUNT + 1 ) * 2][2] {};
+    int32_t symbol_[( HPACK_HUFFMAN_SYMBOL_COUNT + 1 ) * 2] {};
+  };
+
+  static const HuffmanTree& huffmanTree()
+  {
+    static const HuffmanTree tree = [] {
+      HuffmanTree tree;
+      std::fill( std::begin( tree.symbol_ ), std::end( tree.symbol_ ), -1 );
+      int32_t count = 1;
+      for ( uint32_t symbol = 0; symbol <= HPACK_HUFFMAN_SYMBOL_COUNT; ++symbol ) {
+        bool eos = HPACK_HUFFMAN_EOS == symbol;
+        uint32_t code = eos ? HPACK_HUFFMAN_EOS_CODE : HPACK_HUFFMAN_CODES[symbol];
+        uint8_t codeLen = eos ? HPACK_HUFFMAN_EOS_LEN : HPACK_HUFFMAN_CODE_LENS[symbol];
+        int32_t node = 0;
+        for ( int32_t bit = codeLen - 1; bit >= 0; --bit ) {
+          uint32_t b = ( code >> bit ) & 1;
+          if ( 0 == tree.next_[node][b] ) {
+            tree.next_[node][b] = count++;
+          }
+          node = tree.next_[node][b];
+        }
+        tree.symbol_[node] = static_cast<int32_t>( symbol );
+      }
+      return tree;
+    }();
+    return tree;
+  }
+
+  std::deque<std::pair<std::string, std::string>> entries_; // 动态表，最新的条目在最前面
+  size_t table_size_ { 0 };                                 // 动态表当前的长度
+  size_t table_size_limit_ { HPACK_DEFAULT_TABLE_SIZE };    // 对端通过长度更新设置的上限
+  size_t max_table_size_ { HPACK_DEFAULT_TABLE_SIZE };      // 通告给对端的上限
+  HpackEntry lookup_entry_;                                 // 动态表条目的视图
+  std::string name_buf_;                                    // huffman解码的name
+  std::string value_buf_;                                   // huffman解码的value
+};
+
+/* HPACK编码，不使用动态表，这样不需要跟踪对端的SETTINGS_HEADER_TABLE_SIZE
+ * name在静态表中存在时使用索引，字面值经过huffman编码更短时使用huffman编码，name统一转为小写
+ */
+class HpackEncoder
+{
+public:
+  static void Encode( std::string_view name, std::string_view value, Packet& out )
+  {
+    uint32_t nameIndex = 0;
+    for ( uint32_t i = 0; i < HPACK_STATIC_TABLE_LEN; ++i ) {
+      const HpackEntry& entry = HPACK_STATIC_TABLE[i];
+      if ( entry.name_.size() != name.size() || 0 != strncasecmp( entry.name_.data(), name.data(), name.size() ) ) {
+        continue;
+      }
+      if ( entry.value_ == value ) { // 完全匹配，只需要编码索引
+        out.ReAlloc( out.UseLen() + HPACK_MAX_INT_LEN + 1 );
+        encodeInt( i + 1, 7, 0x80, out );
+        return;
+      }
+      if ( 0 == nameIndex ) {
+        nameIndex = i + 1;
+      }
+    }
+
+    // 不索引的字面值：0000xxxx
+    out.ReAlloc( out.UseLen() + ( HPACK_MAX_INT_LEN + 1 ) * 3 + name.size() + value.size() );
+    encodeInt( nameIndex, 4, 0x00, out );
+    if ( 0 == nameIndex ) {
+      encodeString( name, true, out );
+    }
+    encodeString( value, false, out );
+  }
+
+private:
+  static void encodeInt( uint64_t value, uint32_t prefixBits, uint8_t flag, Packet& out )
+  {
+    uint8_t* data = out.Data();
+    uint64_t mask = ( 1u << prefixBits ) - 1;
+    size_t len = 0;
+    if ( value < mask ) {
+      data[len++] = flag | static_cast<uint8_t>( value );
+    } else {
+      data[len++] = flag | static_cast<uint8_t>( mask );
+      value -= mask;
+      while ( value >= 0x80 ) {
+        data[len++] = static_cast<uint8_t>( 0x80 | ( value & 0x7f ) );
+        value >>= 7;
+      }
+      data[len++] = static_cast<uint8_t>( value );
+    }
+    out.UpdateUseLen( len );
+  }
+
+  static void encodeString( std::string_view str, bool lower, Packet& out )
+  {
+    size_t bits = 0;
+    for ( char c : str ) {
+      bits += HPACK_HUFFMAN_CODE_LENS[symbol( c, lower )];
+    }
+    size_t huffmanLen = ( bits + 7 ) / 8;
+    if ( huffmanLen >= str.size() ) {
+      encodeInt( str.size(), 7, 0x00, out );
+      uint8_t* data = out.Data();
+      for ( size_t i = 0; i < str.size(); ++i ) {
+        data[i] = symbol( str[i], lower );
+      }
+      out.UpdateUseLen( str.size() );
+      return;
+    }
+
+    encodeInt( huffmanLen, 7, 0x80, out );
+    uint8_t* data = out.Data();
+    uint64_t acc = 0; // 还没有写出的比特，最多7位加上一个30位的编码
+    uint32_t accBits = 0;
+    for ( char c : str ) {
+      uint8_t s = symbol( c, lower );
+      acc = ( acc << HPACK_HUFFMAN_CODE_LENS[s] ) | HPACK_HUFFMAN_CODES[s];
+      accBits += HPACK_HUFFMAN_CODE_LENS[s];
+      while ( accBits >= 8 ) {
+        accBits -= 8;
+        *data++ = static_cast<uint8_t>( acc >> accBits );
+      }
+    }
+    if ( accBits > 0 ) { // 用EOS的前缀（全1）填充
+      *data++ = static_cast<uint8_t>( ( acc << ( 8 - accBits ) ) | ( 0xff >> accBits ) );
+    }
+    out.UpdateUseLen( huffmanLen );
+  }
+
+  static uint8_t symbol( char c, bool lower )
+  {
+    auto s = static_cast<uint8_t>( c );
+    return lower && s >= 'A' && s <= 'Z' ? s - 'A' + 'a' : s;
+  }
+};
+} // namespace Protocol
\ No newline at end of file
@@ -0,0 +1,712 @@
+#pragma once
+#include <strings.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "codec.hpp"
+#include "common/log.hpp"
+#include "hpack.hpp"
+#include "httpmessage.hpp"
+#include "protocol/packet.hpp"
+
+namespace Protocol {
+constexpr char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"; // 客户端的连接前言
+constexpr uint32_t H2_PREFACE_LEN = sizeof( H2_PREFACE ) - 1;
+constexpr uint32_t H2_FRAME_HEAD_LEN = 9;            // 帧头长度
+constexpr uint32_t H2_DEFAULT_FRAME_SIZE = 16384;    // 协议默认的最大帧长度，接收时不调整
+constexpr uint32_t H2_MAX_FRAME_SIZE = 16777215;     // SETTINGS_MAX_FRAME_SIZE的上限
+constexpr int64_t H2_DEFAULT_WINDOW = 65535;         // 协议默认的流控窗口
+constexpr int64_t H2_MAX_WINDOW = 0x7fffffff;        // 流控窗口的上限
+constexpr uint32_t H2_RECV_WINDOW = 1024 * 1024;     // 通告给对端的接收窗口，连接和流都使用这个值
+constexpr uint32_t H2_MAX_CONCURRENT_STREAMS = 1024; // 通告给对端的最大并发流数
+constexpr uint32_t H2_MAX_HEADER_LEN = 16 * 1024;    // header block解码之后的最大长度
+constexpr uint32_t H2_MAX_BODY_LEN = 1024 * 1024;    // 每个请求body的最大长度
+// 每次读取的数据量，能放下一个最大的帧
+constexpr uint32_t H2_READ_LEN = H2_FRAME_HEAD_LEN + H2_DEFAULT_FRAME_SIZE;
+
+// 帧类型
+enum Http2FrameType
+{
+  H2_DATA = 0,
+  H2_HEADERS = 1,
+  H2_PRIORITY = 2,
+  H2_RST_STREAM = 3,
+  H2_SETTINGS = 4,
+  H2_PUSH_PROMISE = 5,
+  H2_PING = 6,
+  H2_GOAWAY = 7,
+  H2_WINDOW_UPDATE = 8,
+  H2_CONTINUATION = 9,
+};
+
+// 帧标志
+enum Http2Flag
+{
+  H2_FLAG_END_STREAM = 0x1,  // DATA，HEADERS
+  H2_FLAG_ACK = 0x1,         // SETTINGS，PING
+  H2_FLAG_END_HEADERS = 0x4, // HEADERS，CONTINUATION
+  H2_FLAG_PADDED = 0x8,      // DATA，HEADERS
+  H2_FLAG_PRIORITY = 0x20,   // HEADERS
+};
+
+enum Http2Setting
+{
+  H2_SETTINGS_HEADER_TABLE_SIZE = 1,
+  H2_SETTINGS_ENABLE_PUSH = 2,
+  H2_SETTINGS_MAX_CONCURRENT_STREAMS = 3,
+  H2_SETTINGS_INITIAL_WINDOW_SIZE = 4,
+  H2_SETTINGS_MAX_FRAME_SIZE = 5,
+  H2_SETTINGS_MAX_HEADER_LIST_SIZE = 6,
+};
+
+// RST_STREAM和GOAWAY中的错误码
+enum Http2ErrorCode
+{
+  H2_NO_ERROR = 0,
+  H2_PROTOCOL_ERROR = 1,
+  H2_FLOW_CONTROL_ERROR = 3,
+  H2_REFUSED_STREAM = 7,
+  H2_CANCEL = 8,
+};
+
+// 一个流的状态，请求接收完成之后交给上层，流一直保留到应答发送完成
+struct Http2Stream
+{
+  std::unique_ptr<HttpMessage> message_;   // 正在接收的请求
+  Packet body_;                            // 请求的body，接收完成之后交给消息
+  Packet send_buf_;                        // 流控窗口不足时还没有发送的应答数据
+  int64_t send_window_ { 0 };              // 发送窗口
+  int64_t recv_window_ { H2_RECV_WINDOW }; // 对端在这个流上还可以发送的数据量
+  uint32_t recv_unacked_ { 0 };            // 已经接收但还没有通过WINDOW_UPDATE归还的窗口
+  bool recv_headers_ { false };            // 已经接收到header，之后的header block是trailer
+  bool recv_end_ { false };                // 请求已经接收完成
+};
+
+/* HTTP/2 over TCP（h2c prior knowledge），请求和应答都复用HttpMessage
+ * 请求的first_line_由伪header拼成"METHOD PATH HTTP/2.0"，header都是小写，seq_是流id，应答需要把seq_设置为请求的seq_
+ * 除了应答之外，codec自己还需要发送SETTINGS，PING和WINDOW_UPDATE等控制帧，Decode之后需要通过TakeOutput取出发送
+ */
+class Http2Codec : public Codec
+{
+public:
+  Http2Codec()
+  {
+    pkt_.Alloc( H2_READ_LEN );
+    out_.Alloc( 0 );
+    // 服务端的连接前言：SETTINGS帧，以及把连接的接收窗口扩大到H2_RECV_WINDOW
+    uint8_t* payload = appendFrame( 12, H2_SETTINGS, 0, 0 );
+    payload = writeSetting( payload, H2_SETTINGS_MAX_CONCURRENT_STREAMS, H2_MAX_CONCURRENT_STREAMS );
+    writeSetting( payload, H2_SETTINGS_INITIAL_WINDOW_SIZE, H2_RECV_WINDOW );
+    appendWindowUpdate( 0, H2_RECV_WINDOW - H2_DEFAULT_WINDOW );
+  }
+
+  CodecType Type() override { return HTTP2; }
+
+  // 多个流的请求一次Decode可能解析出多个，需要循环获取直到返回nullptr
+  void* GetMessage() override
+  {
+    if ( messages_.empty() ) {
+      return nullptr;
+    }
+    HttpMessage* message = messages_.front().release();
+    messages_.pop();
+    return message;
+  }
+
+  void SetLimit( uint32_t maxHeaderLen, uint32_t maxBodyLen )
+  {
+    max_header_len_ = maxHeaderLen;
+    max_body_len_ = maxBodyLen;
+  }
+
+  // 编码应答，待发送的控制帧也一起编码到pkt中。流控窗口不足时剩余的数据先缓存，窗口更新之后通过TakeOutput发送
+  bool Encode( void* msg, Packet& pkt ) override
+  {
+    auto* message = static_cast<HttpMessage*>( msg );
+    auto iter = streams_.find( static_cast<uint32_t>( message->seq_ ) );
+    // 流已经被对端重置，应答直接丢弃
+    if ( iter != streams_.end() ) {
+      encodeResponse( iter, *message );
+    }
+    TakeOutput( pkt );
+    return true;
+  }
+
+  bool TakeOutput( Packet& pkt ) override
+  {
+    if ( 0 == out_.UseLen() ) {
+      pkt.Alloc( 0 );
+      return false;
+    }
+    pkt = std::move( out_ ); // 交换缓冲区，不需要拷贝
+    out_.Alloc( 0 );
+    // WINDOW_UPDATE交给调用方发送之后，对端才可能拿到新的窗口
+    for ( const auto& [streamId, increment] : pending_window_updates_ ) {
+      if ( 0 == streamId ) {
+        conn_recv_window_ += increment;
+      } else if ( auto iter = streams_.find( streamId ); iter != streams_.end() ) {
+        iter->second.recv_window_ += increment;
+      }
+    }
+    pending_window_updates_.clear();
+    return true;
+  }
+
+  bool Decode( size_t len ) override
+  {
+    pkt_.UpdateUseLen( len );
+    uint32_t decodeLen = 0;
+    uint32_t needDecodeLen = pkt_.NeedParseLen();
+    uint8_t* data = pkt_.DataParse();
+    uint32_t needFrameLen = 0; // 不完整的帧还需要的总长度
+
+    if ( !preface_done_ ) {
+      uint32_t cmpLen = std::min( needDecodeLen, H2_PREFACE_LEN );
+      if ( 0 != memcmp( data, H2_PREFACE, cmpLen ) ) {
+        ERROR( "invalid http2 connection preface" );
+        return false;
+      }
+      if ( cmpLen == H2_PREFACE_LEN ) {
+        preface_done_ = true;
+        needDecodeLen -= H2_PREFACE_LEN;
+        decodeLen += H2_PREFACE_LEN;
+        data += H2_PREFACE_LEN;
+      }
+    }
+
+    while ( preface_done_ && needDecodeLen >= H2_FRAME_HEAD_LEN ) {
+      uint32_t frameLen = ( data[0] << 16 ) | ( data[1] << 8 ) | data[2];
+      if ( frameLen > H2_DEFAULT_FRAME_SIZE ) {
+        ERROR( "http2 frame len[%u] is too long", frameLen );
+        return false;
+      }
+      if ( needDecodeLen < H2_FRAME_HEAD_LEN + frameLen ) {
+        needFrameLen = H2_FRAME_HEAD_LEN + frameLen;
+        break;
+      }
+
+      uint8_t type = data[3];
+      uint8_t flags = data[4];
+      uint32_t streamId = readUint32( data + 5 ) & 0x7fffffff;
+      if ( !decodeFrame( type, flags, streamId, data + H2_FRAME_HEAD_LEN, frameLen ) ) {
+        return false;
+      }
+      needDecodeLen -= H2_FRAME_HEAD_LEN + frameLen;
+      decodeLen += H2_FRAME_HEAD_LEN + frameLen;
+      data += H2_FRAME_HEAD_LEN + frameLen;
+    }
+
+    // 解析出的消息都拷贝了header和body，接收缓冲区可以直接回收
+    pkt_.UpdateParseLen( decodeLen );
+    pkt_.Compact();
+    pkt_.ReAlloc( pkt_.ParseLen() + std::max( needFrameLen, H2_READ_LEN ) );
+    return true;
+  }
+
+private:
+  bool decodeFrame( uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    // header block必须是连续的HEADERS，CONTINUATION帧，中间不能插入其它帧
+    if ( header_stream_id_ != 0 && ( type != H2_CONTINUATION || streamId != header_stream_id_ ) ) {
+      ERROR( "http2 expect CONTINUATION of stream[%u]", header_stream_id_ );
+      return false;
+    }
+
+    switch ( type ) {
+      case H2_DATA:
+        return decodeData( flags, streamId, payload, len );
+      case H2_HEADERS:
+        return decodeHeaders( flags, streamId, payload, len );
+      case H2_CONTINUATION:
+        return decodeContinuation( flags, streamId, payload, len );
+      case H2_RST_STREAM:
+        streams_.erase( streamId );
+        return true;
+      case H2_SETTINGS:
+        return decodeSettings( flags, streamId, payload, len );
+      case H2_PING:
+        return decodePing( flags, payload, len );
+      case H2_GOAWAY:
+        INFO( "http2 receive GOAWAY, error code[%u]", len >= 8 ? readUint32( payload + 4 ) : 0 );
+        return true;
+      case H2_WINDOW_UPDATE:
+        return decodeWindowUpdate( streamId, payload, len );
+      case H2_PUSH_PROMISE:
+        ERROR( "http2 client can not send PUSH_PROMISE" );
+        return false;
+      default: // PRIORITY以及未知类型的帧直接忽略
+        return true;
+    }
+  }
+
+  bool decodeData( uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    if ( 0 == streamId ) {
+      ERROR( "http2 DATA frame on stream 0" );
+      return false;
+    }
+    // 填充也计入流控，不管流是否还存在都需要归还连接的窗口。超过对端已经拿到的窗口属于连接错误
+    if ( len > conn_recv_window_ ) {
+      ERROR( "http2 connection receive window[%ld] exceeded, len[%u]", conn_recv_window_, len );
+      return false;
+    }
+    uint32_t flowLen = len;
+    conn_recv_window_ -= len;
+    conn_recv_unacked_ += len;
+    if ( conn_recv_unacked_ >= H2_RECV_WINDOW / 2 ) {
+      appendWindowUpdate( 0, conn_recv_unacked_ );
+      conn_recv_unacked_ = 0;
+    }
+    if ( !stripPadding( flags, payload, len ) ) {
+      return false;
+    }
+
+    auto iter = streams_.find( streamId );
+    if ( iter == streams_.end() || iter->second.recv_end_ ) {
+      return true;
+    }
+    Http2Stream& stream = iter->second;
+    if ( flowLen > stream.recv_window_ ) { // 超过流的接收窗口，只重置这个流
+      ERROR( "http2 stream[%u] receive window[%ld] exceeded, len[%u]", streamId, stream.recv_window_, flowLen );
+      resetStream( iter, H2_FLOW_CONTROL_ERROR );
+      return true;
+    }
+    stream.recv_window_ -= flowLen;
+    Packet& body = stream.body_;
+    if ( body.UseLen() + len > max_body_len_ ) {
+      ERROR( "http2 stream[%u] body len[%lu] is too long", streamId, body.UseLen() + len );
+      resetStream( iter, H2_CANCEL );
+      return true;
+    }
+    if ( len > 0 ) {
+      body.ReAlloc( body.UseLen() + len );
+      memcpy( body.Data(), payload, len );
+      body.UpdateUseLen( len );
+    }
+
+    if ( flags & H2_FLAG_END_STREAM ) {
+      finishRequest( iter );
+      return true;
+    }
+    stream.recv_unacked_ += flowLen;
+    if ( stream.recv_unacked_ >= H2_RECV_WINDOW / 2 ) {
+      appendWindowUpdate( streamId, stream.recv_unacked_ );
+      stream.recv_unacked_ = 0;
+    }
+    return true;
+  }
+
+  bool decodeHeaders( uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    if ( 0 == streamId || 0 == ( streamId & 1 ) ) {
+      ERROR( "http2 invalid request stream[%u]", streamId );
+      return false;
+    }
+    if ( !stripPadding( flags, payload, len ) ) {
+      return false;
+    }
+    if ( flags & H2_FLAG_PRIORITY ) { // 依赖的流id和权重，忽略
+      if ( len < 5 ) {
+        ERROR( "http2 HEADERS frame too short" );
+        return false;
+      }
+      payload += 5;
+      len -= 5;
+    }
+
+    auto iter = streams_.find( streamId );
+    if ( iter == streams_.end() ) {
+      if ( streamId <= last_stream_id_ ) {
+        ERROR( "http2 stream[%u] is closed or not increase", streamId );
+        return false;
+      }
+      last_stream_id_ = streamId;
+      if ( streams_.size() < H2_MAX_CONCURRENT_STREAMS ) {
+        Http2Stream& stream = streams_[streamId];
+        stream.message_ = std::make_unique<HttpMessage>();
+        stream.send_window_ = peer_initial_window_;
+      } else {
+        appendRstStream( streamId, H2_REFUSED_STREAM );
+      }
+    }
+
+    header_block_.Alloc( len );
+    if ( len > 0 ) {
+      memcpy( header_block_.Data(), payload, len );
+    }
+    header_block_.UpdateUseLen( len );
+    header_end_stream_ = flags & H2_FLAG_END_STREAM;
+    if ( flags & H2_FLAG_END_HEADERS ) {
+      return decodeHeaderBlock( streamId );
+    }
+    header_stream_id_ = streamId;
+    return true;
+  }
+
+  bool decodeContinuation( uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    if ( 0 == header_stream_id_ ) {
+      ERROR( "http2 unexpected CONTINUATION of stream[%u]", streamId );
+      return false;
+    }
+    if ( header_block_.UseLen() + len > max_header_len_ ) {
+      ERROR( "http2 header block len[%lu] is too long", header_block_.UseLen() + len );
+      return false;
+    }
+    header_block_.ReAlloc( header_block_.UseLen() + len );
+    if ( len > 0 ) {
+      memcpy( header_block_.Data(), payload, len );
+    }
+    header_block_.UpdateUseLen( len );
+    if ( flags & H2_FLAG_END_HEADERS ) {
+      header_stream_id_ = 0;
+      return decodeHeaderBlock( streamId );
+    }
+    return true;
+  }
+
+  // 完整的header block，即使流已经被拒绝或者是trailer，也要解码以保持动态表同步
+  bool decodeHeaderBlock( uint32_t streamId )
+  {
+    auto iter = streams_.find( streamId );
+    HttpMessage* message = nullptr; // 只有请求的header需要保存，trailer直接忽略
+    if ( iter != streams_.end() && !iter->second.recv_headers_ ) {
+      message = iter->second.message_.get();
+    }
+
+    std::string method;
+    std::string path;
+    size_t headerLen = 0;
+    auto handler = [&]( std::string_view name, std::string_view value ) {
+      headerLen += name.size() + value.size() + HPACK_ENTRY_OVERHEAD;
+      if ( headerLen > max_header_len_ ) {
+        ERROR( "http2 header len[%lu] is too long", headerLen );
+        return false;
+      }
+      if ( nullptr == message ) {
+        return true;
+      }
+      if ( name == ":method" ) {
+        method = value;
+      } else if ( name == ":path" ) {
+        path = value;
+      } else if ( name.empty() || name[0] != ':' ) { // 其它伪header不需要
+        message->AppendHeader( name, value );
+      }
+      return true;
+    };
+    if ( !hpack_decoder_.Decode( header_block_.DataRaw(), header_block_.UseLen(), handler ) ) {
+      ERROR( "http2 stream[%u] decode header block failed", streamId );
+      return false;
+    }
+    if ( iter == streams_.end() || iter->second.recv_end_ ) {
+      return true;
+    }
+
+    if ( message != nullptr ) {
+      if ( method.empty() || path.empty() ) {
+        resetStream( iter, H2_PROTOCOL_ERROR );
+        return true;
+      }
+      message->SetFirstLine( method + " " + path + " HTTP/2.0" );
+      iter->second.recv_headers_ = true;
+    }
+    if ( header_end_stream_ ) {
+      finishRequest( iter );
+    }
+    return true;
+  }
+
+  bool decodeSettings( uint8_t flags, uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    if ( streamId != 0 || len % 6 != 0 ) {
+      ERROR( "http2 invalid SETTINGS frame" );
+      return false;
+    }
+    if ( flags & H2_FLAG_ACK ) {
+      return true;
+    }
+
+    for ( uint32_t i = 0; i < len; i += 6 ) {
+      uint16_t id = ( payload[i] << 8 ) | payload[i + 1];
+      uint32_t value = readUint32( payload + i + 2 );
+      if ( H2_SETTINGS_INITIAL_WINDOW_SIZE == id ) {
+        if ( value > H2_MAX_WINDOW ) {
+          ERROR( "http2 invalid initial window size[%u]", value );
+          return false;
+        }
+        // 初始窗口的变化对所有已经存在的流生效
+        int64_t delta = static_cast<int64_t>( value ) - peer_initial_window_;
+        for ( auto& item : streams_ ) {
+          item.second.send_window_ += delta;
+        }
+        peer_initial_window_ = value;
+      } else if ( H2_SETTINGS_MAX_FRAME_SIZE == id ) {
+        if ( value < H2_DEFAULT_FRAME_SIZE || value > H2_MAX_FRAME_SIZE ) {
+          ERROR( "http2 invalid max frame size[%u]", value );
+          return false;
+        }
+        peer_max_frame_size_ = value;
+      }
+    }
+    appendFrame( 0, H2_SETTINGS, H2_FLAG_ACK, 0 );
+    flushPending();
+    return true;
+  }
+
+  bool decodePing( uint8_t flags, const uint8_t* payload, uint32_t len )
+  {
+    if ( len != 8 ) {
+      ERROR( "http2 invalid PING frame" );
+      return false;
+    }
+    if ( 0 == ( flags & H2_FLAG_ACK ) ) {
+      memcpy( appendFrame( 8, H2_PING, H2_FLAG_ACK, 0 ), payload, 8 );
+    }
+    return true;
+  }
+
+  bool decodeWindowUpdate( uint32_t streamId, const uint8_t* payload, uint32_t len )
+  {
+    if ( len != 4 ) {
+      ERROR( "http2 invalid WINDOW_UPDATE frame" );
+      return false;
+    }
+    uint32_t increment = readUint32( payload ) & 0x7fffffff;
+    if ( 0 == increment ) {
+      ERROR( "http2 WINDOW_UPDATE increment is 0" );
+      return false;
+    }
+    if ( 0 == streamId ) {
+      conn_send_window_ += increment;
+      if ( conn_send_window_ > H2_MAX_WINDOW ) {
+        ERROR( "http2 connection window overflow" );
+        return false;
+      }
+    } else if ( auto iter = streams_.find( streamId ); iter != streams_.end() ) {
+      iter->second.send_window_ += increment;
+      if ( iter->second.send_window_ > H2_MAX_WINDOW ) {
+        resetStream( iter, H2_PROTOCOL_ERROR );
+        return true;
+      }
+    }
+    flushPending();
+    return true;
+  }
+
+  void finishRequest( std::unordered_map<uint32_t, Http2Stream>::iterator iter )
+  {
+    Http2Stream& stream = iter->second;
+    stream.recv_end_ = true;
+    HttpMessage& message = *stream.message_;
+    message.buf_ = std::move( stream.body_ );
+    message.body_ = std::string_view( reinterpret_cast<char*>( message.buf_.DataRaw() ), message.buf_.UseLen() );
+    message.seq_ = iter->first;
+    messages_.push( std::move( stream.message_ ) );
+  }
+
+  void resetStream( std::unordered_map<uint32_t, Http2Stream>::iterator iter, Http2ErrorCode errorCode )
+  {
+    appendRstStream( iter->first, errorCode );
+    streams_.erase( iter );
+  }
+
+  void encodeResponse( std::unordered_map<uint32_t, Http2Stream>::iterator iter, HttpMessage& message )
+  {
+    // status_line的第二个字段是状态码
+    std::string_view status = "200";
+    size_t statusBegin = message.first_line_.find( ' ' );
+    if ( statusBegin != std::string_view::npos ) {
+      status = message.first_line_.substr( statusBegin + 1, 3 );
+    }
+
+    encode_block_.Alloc( 0 );
+    HpackEncoder::Encode( ":status", status, encode_block_ );
+    for ( size_t i = 0; i < message.HeaderCount(); ++i ) {
+      const HttpHeader& header = message.Header( i );
+      if ( !isConnectionHeader( header.key_ ) ) {
+        HpackEncoder::Encode( header.key_, header.value_, encode_block_ );
+      }
+    }
+
+    // header block超过对端的最大帧长度时，拆分成HEADERS和多个CONTINUATION
+    bool endStream = message.body_.empty();
+    const uint8_t* block = encode_block_.DataRaw();
+    size_t blockLen = encode_block_.UseLen();
+    uint8_t type = H2_HEADERS;
+    uint8_t flags = endStream ? H2_FLAG_END_STREAM : 0;
+    do {
+      auto len = static_cast<uint32_t>( std::min<size_t>( blockLen, peer_max_frame_size_ ) );
+      blockLen -= len;
+      if ( 0 == blockLen ) {
+        flags |= H2_FLAG_END_HEADERS;
+      }
+      memcpy( appendFrame( len, type, flags, iter->first ), block, len );
+      block += len;
+      type = H2_CONTINUATION;
+      flags = 0;
+    } while ( blockLen > 0 );
+
+    if ( endStream ) {
+      streams_.erase( iter );
+      return;
+    }
+
+    Http2Stream& stream = iter->second;
+    const auto* body = reinterpret_cast<const uint8_t*>( message.body_.data() );
+    size_t sendLen = appendData( iter->first, stream, body, message.body_.size() );
+    if ( sendLen == message.body_.size() ) {
+      streams_.erase( iter );
+      return;
+    }
+    // 窗口不足，剩余的数据等窗口更新之后再发送
+    size_t leftLen = message.body_.size() - sendLen;
+    stream.send_buf_.Alloc( leftLen );
+    memcpy( stream.send_buf_.Data(), body + sendLen, leftLen );
+    stream.send_buf_.UpdateUseLen( leftLen );
+  }
+
+  // 在流控窗口允许的范围内编码DATA帧，返回编码的长度，数据全部编码时最后一帧带上END_STREAM
+  size_t appendData( uint32_t streamId, Http2Stream& stream, const uint8_t* data, size_t len )
+  {
+    size_t sendLen = 0;
+    while ( sendLen < len ) {
+      int64_t window = std::min( conn_send_window_, stream.send_window_ );
+      if ( window <= 0 ) {
+        break;
+      }
+      auto frameLen = static_cast<uint32_t>(
+        std::min<int64_t>( { static_cast<int64_t>( len - sendLen ), peer_max_frame_size_, window } ) );
+      uint8_t flags = sendLen + frameLen == len ? H2_FLAG_END_STREAM : 0;
+      memcpy( appendFrame( frameLen, H2_DATA, flags, streamId ), data + sendLen, frameLen );
+      sendLen += frameLen;
+      conn_send_window_ -= frameLen;
+      stream.send_window_ -= frameLen;
+    }
+    return sendLen;
+  }
+
+  // 窗口更新之后继续发送缓存的应答数据，发送完成的流可以释放
+  void flushPending()
+  {
+    for ( auto iter = streams_.begin(); iter != streams_.end() && conn_send_window_ > 0; ) {
+      Packet& sendBuf = iter->second.send_buf_;
+      if ( 0 == sendBuf.NeedParseLen() ) {
+        ++iter;
+        continue;
+      }
+      size_t sendLen = appendData( iter->first, iter->second, sendBuf.DataParse(), sendBuf.NeedParseLen() );
+      sendBuf.UpdateParseLen( sendLen );
+      if ( 0 == sendBuf.NeedParseLen() ) {
+        iter = streams_.erase( iter );
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  // 连接相关的header在HTTP/2中是非法的
+  static bool isConnectionHeader( std::string_view key )
+  {
+    constexpr std::string_view headers[]
+      = { "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade" };
+    for ( std::string_view header : headers ) {
+      if ( header.size() == key.size() && 0 == strncasecmp( header.data(), key.data(), key.size() ) ) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 去掉PADDED标志的填充，len更新为去掉填充之后的长度
+  static bool stripPadding( uint8_t flags, const uint8_t*& payload, uint32_t& len )
+  {
+    if ( 0 == ( flags & H2_FLAG_PADDED ) ) {
+      return true;
+    }
+    if ( len < 1 || payload[0] >= len ) {
+      ERROR( "http2 invalid padding" );
+      return false;
+    }
+    len -= 1 + payload[0];
+    payload += 1;
+    return true;
+  }
+
+  void appendWindowUpdate( uint32_t streamId, uint32_t increment )
+  {
+    writeUint32( appendFrame( 4, H2_WINDOW_UPDATE, 0, streamId ), increment );
+    pending_window_updates_.emplace_back( streamId, increment );
+  }
+
+  void appendRstStream( uint32_t streamId, Http2ErrorCode errorCode )
+  {
+    writeUint32( appendFrame( 4, H2_RST_STREAM, 0, streamId ), errorCode );
+  }
+
+  // 在out_中追加一个帧头，返回payload的写入地址，需要在下一次追加之前写完
+  uint8_t* appendFrame( uint32_t len, uint8_t type, uint8_t flags, uint32_t streamId )
+  {
+    out_.ReAlloc( out_.UseLen() + H2_FRAME_HEAD_LEN + len );
+    uint8_t* head = out_.Data();
+    head[0] = static_cast<uint8_t>( len >> 16 );
+    head[1] = static_cast<uint8_t>( len >> 8 );
+    head[2] = static_cast<uint8_t>( len );
+    head[3] = type;
+    head[4] = flags;
+    writeUint32( head + 5, streamId );
+    out_.UpdateUseLen( H2_FRAME_HEAD_LEN + len );
+    return head + H2_FRAME_HEAD_LEN;
+  }
+
+  static uint8_t* writeSetting( uint8_t* data, uint16_t id, uint32_t value )
+  {
+    data[0] = static_cast<uint8_t>( id >> 8 );
+    data[1] = static_cast<uint8_t>( id );
+    writeUint32( data + 2, value );
+    return data + 6;
+  }
+
+  static void writeUint32( uint8_t* data, uint32_t value )
+  {
+    data[0] = static_cast<uint8_t>( value >> 24 );
+    data[1] = static_cast<uint8_t>( value >> 16 );
+    data[2] = static_cast<uint8_t>( value >> 8 );
+    data[3] = static_cast<uint8_t>( value );
+  }
+
+  static uint32_t readUint32( const uint8_t* data )
+  {
+    return ( static_cast<uint32_t>( data[0] ) << 24 ) | ( data[1] << 16 ) | ( data[2] << 8 ) | data[3];
+  }
+
+private:
+  bool preface_done_ { false };                            // 是否已经收到连接前言
+  std::unordered_map<uint32_t, Http2Stream> streams_;      // 还没有完成的流
+  std::queue<std::unique_ptr<HttpMessage>> messages_;      // 接收完成，等待取出的请求
+  uint32_t last_stream_id_ { 0 };                          // 最大的请求流id，新的流id必须更大
+  HpackDecoder hpack_decoder_;                             // 整个连接共享一个动态表
+  Packet header_block_;                                    // 拼接HEADERS和CONTINUATION
+  Packet encode_block_;                                    // 编码应答的header block
+  uint32_t header_stream_id_ { 0 };                        // 正在接收CONTINUATION的流
+  bool header_end_stream_ { false };                       // 正在接收的header block是否带有END_STREAM
+  Packet out_;                                             // 待发送的帧
+  int64_t conn_send_window_ { H2_DEFAULT_WINDOW };         // 连接的发送窗口
+  int64_t peer_initial_window_ { H2_DEFAULT_WINDOW };      // 对端设置的流的初始窗口
+  uint32_t peer_max_frame_size_ { H2_DEFAULT_FRAME_SIZE }; // 对端能接收的最大帧长度
+  uint32_t conn_recv_unacked_ { 0 };                       // 已经接收但还没有归还的连接窗口
+  int64_t conn_recv_window_ { H2_DEFAULT_WINDOW };         // 对端在连接上还可以发送的数据量
+  std::vector<std::pair<uint32_t, uint32_t>> pending_window_updates_; // 已经编码但还没有取出发送的WINDOW_UPDATE
+  uint32_t max_header_len_ { H2_MAX_HEADER_LEN };
+  uint32_t max_body_len_ { H2_MAX_BODY_LEN };
+};
+
+} // namespace Protocol
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
+#include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <functional>
+#include <map>
 #include <memory>
+#include <queue>
 #include <string>
 
+#include "bytescan.hpp"
 #include "codec.hpp"
 #include "common/log.hpp"
-#include "common/strings.hpp"
 #include "httpmessage.hpp"
 #include "protocol/packet.hpp"
 
@@ -14,16 +19,25 @@ constexpr uint32_t FIRST_READ_LEN = 256;          // 优先读取数据的大小
 constexpr uint32_t MAX_FIRST_LINE_LEN = 8 * 1024; // http第一行的最大长度
 constexpr uint32_t MAX_HEADER_LEN = 8 * 1024;     // header最大长度
 constexpr uint32_t MAX_BODY_LEN = 1024 * 1024;    // body最大长度
+constexpr size_t MAX_PENDING_RESPONSES = 1024;    // 流水线上等待前面的应答而缓存的应答最大个数
 
 // 解码状态
 enum HttpDecodeStatus
 {
-  FIRST_LINE = 1, // 第一行
-  HEADERS = 2,    // 消息头
-  BODY = 3,       // 消息体
-  FINISH = 4,     // 完成了消息解析
+  FIRST_LINE = 1,    // 第一行
+  HEADERS = 2,       // 消息头
+  BODY = 3,          // 消息体
+  FINISH = 4,        // 完成了消息解析
+  CHUNK_SIZE = 5,    // chunked编码的chunk大小行
+  CHUNK_DATA = 6,    // chunked编码的chunk数据
+  CHUNK_TRAILER = 7, // chunked编码结束之后的trailer
 };
 
+/* 流式处理chunked编码的body，每收到一段chunk数据就回调一次，数据只在回调期间有效
+ * body结束时以空chunk，last为true回调一次，返回false表示处理失败，解码也会失败
+ */
+using ChunkHandler = std::function<bool( HttpMessage& message, std::string_view chunk, bool last )>;
+
 // 协议编解码
 class HttpCodec : public Codec
 {
@@ -32,13 +46,15 @@ public:
 
   CodecType Type() override { return HTTP; }
 
+  // 流水线的请求一次Decode可能解析出多个，需要循环获取直到返回nullptr，消息按照接收的顺序返回
   void* GetMessage() override
   {
-    if ( nullptr == message_ || decode_status_ != FINISH ) {
+    if ( messages_.empty() ) {
       return nullptr;
     }
-    decode_status_ = FIRST_LINE;
-    return message_.release();
+    HttpMessage* message = messages_.front().release();
+    messages_.pop();
+    return message;
   }
 
   void SetLimit( uint32_t maxFirstLineLen, uint32_t maxHeaderLen, uint32_t maxBodyLen )
@@ -48,36 +64,74 @@ public:
     max_body_len_ = maxBodyLen;
   }
 
+  // 前面的请求一直没有应答时，后面的应答只能缓存，超过该个数之后Encode失败，由调用方关闭连接
+  void SetMaxPendingResponses( size_t maxPendingResponses ) { max_pending_responses_ = maxPendingResponses; }
+
+  // 设置之后chunked编码的body不再缓存到消息中，而是交给handler流式处理
+  void SetChunkHandler( ChunkHandler handler ) { chunk_handler_ = std::move( handler ); }
+
+  /* 流水线的应答必须按照请求的顺序发送，应答消息的seq_需要设置为对应请求的seq_
+   * 还没轮到的应答先缓存起来，此时pkt为空，轮到之后和前面的应答一起编码到pkt中，seq_为0的消息不参与排序
+   */
   bool Encode( void* msg, Packet& pkt ) override
   {
     auto* message = static_cast<HttpMessage*>( msg );
-    std::string data;
-    data.append( message->first_line_ + "\r\n" );
-    for ( const auto& [key, val] : message->headers_ ) {
-      data.append( key + ": " + val + "\r\n" );
-    }
-    data.append( "\r\n" );
-    data.append( message->body_ );
-    pkt.Alloc( data.length() );
-    memmove( pkt.Data(), data.c_str(), data.length() );
-    pkt.UpdateUseLen( data.length() );
+    if ( 0 == message->seq_ ) {
+      encode( *message, pkt );
+      return true;
+    }
+    if ( message->seq_ < encode_seq_ || pending_responses_.count( message->seq_ ) > 0 ) {
+      ERROR( "http response seq[%lu] is already encoded", message->seq_ );
+      return false;
+    }
+    if ( message->seq_ != encode_seq_ ) {
+      if ( pending_responses_.size() >= max_pending_responses_ ) {
+        ERROR( "http pending responses[%lu] is too many, waiting for seq[%lu]",
+               pending_responses_.size(),
+               encode_seq_ );
+        return false;
+      }
+      encode( *message, pending_responses_[message->seq_] );
+      pkt.Alloc( 0 );
+      return true;
+    }
+
+    encode( *message, pkt );
+    ++encode_seq_;
+    // 后续已经就绪的应答按顺序追加到pkt中
+    for ( auto iter = pending_responses_.find( encode_seq_ ); iter != pending_responses_.end();
+          iter = pending_responses_.find( encode_seq_ ) ) {
+      Packet& pending = iter->second;
+      pkt.ReAlloc( pkt.UseLen() + pending.UseLen() );
+      append( pkt, toView( pending.DataRaw(), pending.DataRaw() + pending.UseLen() ) );
+      pending_responses_.erase( iter );
+      ++encode_seq_;
+    }
     return true;
   }
 
+  // 编码一个chunk，chunk为空时编码的是body的结束标志
+  static void EncodeChunk( std::string_view chunk, Packet& pkt )
+  {
+    pkt.Alloc( chunkLen( chunk.size() ) );
+    appendChunk( pkt, chunk );
+  }
+
   bool Decode( size_t len ) override
   {
     pkt_.UpdateUseLen( len );
     uint32_t decodeLen = 0;
     uint32_t needDecodeLen = pkt_.NeedParseLen();
     uint8_t* data = pkt_.DataParse();
-    if ( nullptr == message_ ) {
-      message_ = std::make_unique<HttpMessage>();
-    }
 
-    // 只要还有未解析的网络字节流，就持续解析
-    while ( needDecodeLen > 0 ) {
+    // 只要还有未解析的网络字节流，就持续解析，流水线的多个请求依次解析到就绪队列中
+    while ( true ) {
       bool decodeBreak = false;
+      if ( nullptr == message_ ) {
+        message_ = std::make_unique<HttpMessage>();
+      }
       if ( FIRST_LINE == decode_status_ ) {
+        message_offset_ = data - pkt_.DataRaw();
         if ( !decodeFirstLine( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
           return false;
         }
@@ -88,7 +142,7 @@ public:
       }
 
       // 解析完第一行，解析headers
-      if ( needDecodeLen > 0 && HEADERS == decode_status_ ) {
+      if ( HEADERS == decode_status_ ) {
         if ( !decodeHeaders( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
           return false;
         }
@@ -98,50 +152,99 @@ public:
         }
       }
 
-      if ( needDecodeLen > 0 ) {
-        pkt_.UpdateParseLen( decodeLen );
+      // 解析完headers，解析body
+      if ( BODY == decode_status_ ) {
+        if ( !decodeBody( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
+          return false;
+        }
+
+        if ( decodeBreak ) {
+          break;
+        }
+      }
+
+      // chunked编码的body
+      if ( CHUNK_SIZE == decode_status_ || CHUNK_DATA == decode_status_ || CHUNK_TRAILER == decode_status_ ) {
+        if ( !decodeChunk( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
+          return false;
+        }
+
+        if ( decodeBreak ) {
+          break;
+        }
       }
 
       if ( FINISH == decode_status_ ) {
-        // 解析完一个消息及时释放空间，并申请新的空间
-        pkt_.Alloc( FIRST_READ_LEN );
+        finishMessage( &data, needDecodeLen, decodeLen );
       }
     }
 
+    pkt_.UpdateParseLen( decodeLen );
+    // 已经交给handler处理的chunk数据，以及已经拷贝走的消息可以回收
+    // 正在解析的消息中的视图还指向接收缓冲区，这时不能移动数据
+    if ( chunk_streaming_ || FIRST_LINE == decode_status_ ) {
+      pkt_.Compact();
+    }
     return true;
   }
 
 private:
-  bool decodeFirstLine( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  // chunked编码的消息，body_不为空时作为第一个chunk发送，后续的chunk以及结束标志通过EncodeChunk发送
+  void encode( const HttpMessage& message, Packet& pkt )
   {
-    uint8_t* temp = *data;
-    bool completeFirstLine = false;
-    uint32_t firstLineLen = 0;
-    for ( uint32_t i = 0; i < needDecodeLen - 1; ++i ) {
-      if ( temp[i] == '\r' && temp[i + 1] == '\n' ) {
-        completeFirstLine = true;
-        firstLineLen = i + 2;
-        break;
-      }
+    // 先计算好总长度，再直接写入pkt，避免中间的字符串拼接
+    size_t len = message.first_line_.size() + 2;
+    for ( size_t i = 0; i < message.HeaderCount(); ++i ) {
+      const HttpHeader& header = message.Header( i );
+      len += header.key_.size() + 2 + header.value_.size() + 2;
+    }
+    len += 2;
+    bool chunked = message.IsChunked();
+    if ( chunked && !message.body_.empty() ) {
+      len += chunkLen( message.body_.size() );
+    } else if ( !chunked ) {
+      len += message.body_.size();
+    }
+    pkt.Alloc( len );
+    append( pkt, message.first_line_ );
+    append( pkt, "\r\n" );
+    for ( size_t i = 0; i < message.HeaderCount(); ++i ) {
+      const HttpHeader& header = message.Header( i );
+      append( pkt, header.key_ );
+      append( pkt, ": " );
+      append( pkt, header.value_ );
+      append( pkt, "\r\n" );
     }
+    append( pkt, "\r\n" );
+    if ( chunked && !message.body_.empty() ) {
+      appendChunk( pkt, message.body_ );
+    } else if ( !chunked ) {
+      append( pkt, message.body_ );
+    }
+  }
 
-    if ( !completeFirstLine ) {
+  bool decodeFirstLine( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    uint8_t* temp = *data;
+    size_t crlfPos = findCrlf( temp, needDecodeLen );
+    if ( crlfPos == needDecodeLen ) {
       if ( needDecodeLen > max_first_line_len_ ) {
         ERROR( "first_line len[%d] is too long", needDecodeLen );
         return false;
       }
-      // 无法完成第一行的解析，则尝试扩大下次读取的数据量
-      pkt_.ReAlloc( pkt_.UseLen() * 2 );
+      // 无法完成第一行的解析，缓冲区已满时扩大下次读取的数据量
+      growIfFull( needDecodeLen );
       decodeBreak = true;
       return true;
     }
 
+    uint32_t firstLineLen = crlfPos + 2;
     if ( firstLineLen > max_first_line_len_ ) {
       ERROR( "first_line len[%d] is too long", firstLineLen );
       return false;
     }
 
-    message_->first_line_ = std::string( reinterpret_cast<char*>( temp ), firstLineLen - 2 );
+    message_->first_line_ = std::string_view( reinterpret_cast<char*>( temp ), firstLineLen - 2 );
     // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
     needDecodeLen -= firstLineLen;
     decodeLen += firstLineLen;
@@ -153,8 +256,20 @@ private:
   bool decodeHeaders( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
   {
     uint8_t* temp = *data;
+    size_t crlfPos = findCrlf( temp, needDecodeLen );
+    if ( crlfPos == needDecodeLen ) {
+      if ( needDecodeLen > max_header_len_ ) {
+        ERROR( "header len[%d] is too long", needDecodeLen );
+        return false;
+      }
+      decodeBreak = true;
+      // 无法完成headers的解析，缓冲区已满时扩大下次读取的数据量
+      growIfFull( needDecodeLen );
+      return true;
+    }
+
     // 解析到空行
-    if ( needDecodeLen >= 2 && temp[0] == '\r' && temp[1] == '\n' ) {
+    if ( 0 == crlfPos ) {
       needDecodeLen -= 2;
       decodeLen += 2;
       ( *data ) += 2;
@@ -162,47 +277,19 @@ private:
       return true;
     }
 
-    bool isKey = true;
-    uint32_t decodeHeadersLen = 0;
-    bool getOneHeader = false;
-    // 解析每个header的key，value对
-    std::string key;
-    std::string value;
-    for ( uint32_t i = 0; i < needDecodeLen - 1; i++ ) {
-      // 一个完整的key，value对
-      if ( temp[i] == '\r' && temp[i + 1] == '\n' ) {
-        Common::Strings::trim( key );
-        Common::Strings::trim( value );
-        if ( !key.empty() && !value.empty() ) {
-          message_->headers_[key] = value;
-        }
-        getOneHeader = true;
-        decodeHeadersLen = i + 2;
-        break;
-      }
-
-      // 第一个':'才是分隔符
-      if ( isKey && temp[i] == ':' ) {
-        isKey = false;
-        continue;
-      }
-
-      if ( !isKey ) {
-        key += temp[i];
-      } else {
-        value += temp[i];
-      }
-    }
-
-    if ( !getOneHeader ) {
-      if ( needDecodeLen > max_header_len_ ) {
-        ERROR( "header len[%d] is too long", needDecodeLen );
-        return false;
+    // 解析每个header的key，value对，第一个':'才是分隔符
+    uint32_t decodeHeadersLen = crlfPos + 2;
+    size_t colonPos = ByteScan::FindChar( temp, crlfPos, ':' );
+    if ( colonPos < crlfPos ) {
+      const uint8_t* keyBegin = temp;
+      const uint8_t* keyEnd = temp + colonPos;
+      const uint8_t* valueBegin = temp + colonPos + 1;
+      const uint8_t* valueEnd = temp + crlfPos;
+      ByteScan::Trim( keyBegin, keyEnd );
+      ByteScan::Trim( valueBegin, valueEnd );
+      if ( keyBegin != keyEnd && valueBegin != valueEnd ) {
+        message_->AddHeader( toView( keyBegin, keyEnd ), toView( valueBegin, valueEnd ) );
       }
-      decodeBreak = true;
-      // 无法完成headers的解析，则尝试扩大下次读取的数据量
-      pkt_.ReAlloc( pkt_.UseLen() * 2 );
-      return true;
     }
 
     if ( decodeHeadersLen > max_header_len_ ) {
@@ -218,29 +305,39 @@ private:
 
   bool decodeBody( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
   {
-    auto iter = message_->headers_.find( "Content-Length" );
-    // 只支持通过Content-Length来标识body的长度
-    if ( iter == message_->headers_.end() ) {
-      ERROR( "not find Content-Length header" );
-      return false;
+    if ( message_->IsChunked() ) {
+      beginChunked( data, needDecodeLen, decodeLen );
+      return true;
+    }
+
+    std::string_view contentLength = message_->GetHeader( "Content-Length" );
+    // 通过Content-Length或者chunked编码来标识body的长度，两者都没有的请求body为空（RFC 7230 3.3.3），例如GET
+    if ( contentLength.empty() ) {
+      message_->body_ = {};
+      decode_status_ = FINISH;
+      return true;
     }
 
-    uint32_t bodyLen = static_cast<uint32_t>( std::stoi( iter->second.c_str() ) );
+    uint32_t bodyLen = 0;
+    auto [ptr, ec] = std::from_chars( contentLength.data(), contentLength.data() + contentLength.size(), bodyLen );
+    if ( ec != std::errc() || ptr != contentLength.data() + contentLength.size() ) {
+      ERROR( "invalid Content-Length[%.*s]", static_cast<int>( contentLength.size() ), contentLength.data() );
+      return false;
+    }
     if ( bodyLen > max_body_len_ ) {
       ERROR( "body len[%d] is too long", bodyLen );
       return false;
     }
 
-    // 不管是否能完成解析都跳出循环
-    decodeBreak = true;
     if ( needDecodeLen < bodyLen ) {
       // 无法完成解析，则尝试扩大下次读取的数据量
-      pkt_.ReAlloc( pkt_.UseLen() + ( bodyLen - needDecodeLen ) );
+      reAlloc( pkt_.UseLen() + ( bodyLen - needDecodeLen ) );
+      decodeBreak = true;
       return true;
     }
 
     uint8_t* temp = *data;
-    message_->body_ = std::string( reinterpret_cast<char*>( temp ), bodyLen );
+    message_->body_ = std::string_view( reinterpret_cast<char*>( temp ), bodyLen );
     // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
     needDecodeLen -= bodyLen;
     decodeLen += bodyLen;
@@ -249,9 +346,277 @@ private:
     return true;
   }
 
+  void beginChunked( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen )
+  {
+    decode_status_ = CHUNK_SIZE;
+    chunk_body_len_ = 0;
+    if ( nullptr == chunk_handler_ ) {
+      // 缓存模式，chunk数据依次移动到headers之后，拼接成连续的body
+      chunk_body_offset_ = *data - pkt_.DataRaw();
+      return;
+    }
+
+    // 流式模式，消息提前接管第一行和headers所在的缓冲区，chunk处理完之后空间就可以回收
+    detachBuffer( data, needDecodeLen, decodeLen );
+    chunk_streaming_ = true;
+  }
+
+  // 完成一个消息的解析，放入就绪队列，从剩余的数据开始解析下一个消息
+  void finishMessage( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen )
+  {
+    if ( !chunk_streaming_ ) {
+      detachBuffer( data, needDecodeLen, decodeLen );
+    }
+    chunk_streaming_ = false;
+    message_->seq_ = ++decode_seq_;
+    messages_.push( std::move( message_ ) );
+    decode_status_ = FIRST_LINE;
+  }
+
+  /* 让消息持有自己的数据，消息中的视图继续有效
+   * 消息位于接收缓冲区的开头，并且后面还没有解析的数据比消息少时，消息直接接管接收缓冲区，
+   * 还没有解析的数据拷贝到新的接收缓冲区，否则只拷贝消息自己的数据，接收缓冲区继续解析后面的请求。
+   * 每次拷贝的量不超过消息自身的长度，消息持有的内存不超过自身长度的两倍，流水线的N个请求总的开销是线性的
+   */
+  void detachBuffer( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen )
+  {
+    uint8_t* begin = pkt_.DataRaw() + message_offset_;
+    size_t messageLen = *data - begin;
+    if ( message_offset_ > 0 || messageLen <= needDecodeLen ) {
+      Packet own;
+      own.Alloc( messageLen );
+      memcpy( own.Data(), begin, messageLen );
+      own.UpdateUseLen( messageLen );
+      message_->Rebase( begin, own.DataRaw() );
+      message_->buf_ = std::move( own );
+      return;
+    }
+
+    Packet pkt;
+    pkt.Alloc( std::max<size_t>( needDecodeLen, FIRST_READ_LEN ) );
+    if ( needDecodeLen > 0 ) {
+      memcpy( pkt.Data(), *data, needDecodeLen );
+    }
+    pkt.UpdateUseLen( needDecodeLen );
+    message_->buf_ = std::move( pkt_ );
+    pkt_ = std::move( pkt );
+    *data = pkt_.DataParse();
+    decodeLen = 0;
+  }
+
+  bool decodeChunk( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    if ( CHUNK_SIZE == decode_status_ ) {
+      return decodeChunkSize( data, needDecodeLen, decodeLen, decodeBreak );
+    }
+    if ( CHUNK_DATA == decode_status_ ) {
+      return decodeChunkData( data, needDecodeLen, decodeLen, decodeBreak );
+    }
+    return decodeChunkTrailer( data, needDecodeLen, decodeLen, decodeBreak );
+  }
+
+  bool decodeChunkSize( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    uint8_t* temp = *data;
+    size_t crlfPos = findCrlf( temp, needDecodeLen );
+    if ( crlfPos == needDecodeLen ) {
+      if ( needDecodeLen > max_header_len_ ) {
+        ERROR( "chunk size len[%d] is too long", needDecodeLen );
+        return false;
+      }
+      growIfFull( needDecodeLen );
+      decodeBreak = true;
+      return true;
+    }
+
+    // chunk大小是16进制数，后面可能跟着";"分隔的扩展参数
+    const uint8_t* sizeBegin = temp;
+    const uint8_t* sizeEnd = temp + ByteScan::FindChar( temp, crlfPos, ';' );
+    ByteScan::Trim( sizeBegin, sizeEnd );
+    std::string_view size = toView( sizeBegin, sizeEnd );
+    uint64_t chunkLen = 0;
+    auto [ptr, ec] = std::from_chars( size.data(), size.data() + size.size(), chunkLen, 16 );
+    if ( ec != std::errc() || ptr != size.data() + size.size() ) {
+      ERROR( "invalid chunk size[%.*s]", static_cast<int>( size.size() ), size.data() );
+      return false;
+    }
+    // 先单独检查chunk大小，避免16位16进制数的chunk大小在后续的长度计算中溢出，单个chunk不能超过body的长度限制
+    if ( chunkLen > max_body_len_ ) {
+      ERROR( "chunk len[%lu] is too long", chunkLen );
+      return false;
+    }
+    // 缓存模式才需要限制body的总长度，chunk_body_len_不会超过max_body_len_，相减不会溢出
+    if ( nullptr == chunk_handler_ && chunkLen > max_body_len_ - chunk_body_len_ ) {
+      ERROR( "body len[%lu] is too long", chunk_body_len_ + chunkLen );
+      return false;
+    }
+
+    needDecodeLen -= crlfPos + 2;
+    decodeLen += crlfPos + 2;
+    ( *data ) += crlfPos + 2;
+    chunk_left_ = chunkLen;
+    decode_status_ = 0 == chunkLen ? CHUNK_TRAILER : CHUNK_DATA;
+    return true;
+  }
+
+  bool decodeChunkData( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    // chunk数据不需要一次收全，收到多少处理多少
+    auto len = static_cast<uint32_t>( std::min<uint64_t>( chunk_left_, needDecodeLen ) );
+    if ( len > 0 ) {
+      if ( chunk_handler_ != nullptr ) {
+        if ( !chunk_handler_( *message_, toView( *data, *data + len ), false ) ) {
+          return false;
+        }
+      } else {
+        memmove( pkt_.DataRaw() + chunk_body_offset_ + chunk_body_len_, *data, len );
+        chunk_body_len_ += len;
+      }
+      needDecodeLen -= len;
+      decodeLen += len;
+      ( *data ) += len;
+      chunk_left_ -= len;
+    }
+
+    // chunk数据之后是"\r\n"
+    if ( chunk_left_ > 0 || needDecodeLen < 2 ) {
+      if ( chunk_handler_ != nullptr ) {
+        growIfFull( needDecodeLen ); // 数据已经交给handler，这里只剩下不完整的CRLF，一般不需要扩容
+      } else {
+        reAlloc( pkt_.UseLen() + chunk_left_ + 2 - needDecodeLen );
+      }
+      decodeBreak = true;
+      return true;
+    }
+    if ( ( *data )[0] != '\r' || ( *data )[1] != '\n' ) {
+      ERROR( "chunk data not end with CRLF" );
+      return false;
+    }
+
+    needDecodeLen -= 2;
+    decodeLen += 2;
+    ( *data ) += 2;
+    decode_status_ = CHUNK_SIZE;
+    return true;
+  }
+
+  bool decodeChunkTrailer( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    size_t crlfPos = findCrlf( *data, needDecodeLen );
+    if ( crlfPos == needDecodeLen ) {
+      if ( needDecodeLen > max_header_len_ ) {
+        ERROR( "trailer len[%d] is too long", needDecodeLen );
+        return false;
+      }
+      growIfFull( needDecodeLen );
+      decodeBreak = true;
+      return true;
+    }
+
+    needDecodeLen -= crlfPos + 2;
+    decodeLen += crlfPos + 2;
+    ( *data ) += crlfPos + 2;
+    if ( crlfPos > 0 ) { // trailer中的header直接忽略
+      return true;
+    }
+
+    // 解析到空行，body结束
+    if ( chunk_handler_ != nullptr ) {
+      if ( !chunk_handler_( *message_, {}, true ) ) {
+        return false;
+      }
+    } else {
+      uint8_t* body = pkt_.DataRaw() + chunk_body_offset_;
+      message_->body_ = toView( body, body + chunk_body_len_ );
+    }
+    decode_status_ = FINISH;
+    return true;
+  }
+
+  // 查找当前行的结束位置，从上次扫描结束的位置继续查找，保证每个字节只扫描一次，找不到返回len
+  size_t findCrlf( const uint8_t* data, size_t len )
+  {
+    size_t begin = scan_len_ > 0 ? scan_len_ - 1 : 0; // 上次扫描的最后一个字节可能是'\r'
+    size_t crlfPos = begin + ByteScan::FindCrlf( data + begin, len - begin );
+    scan_len_ = crlfPos == len ? len : 0;
+    return crlfPos;
+  }
+
+  /* 缓冲区满时扩容，needDecodeLen为还没有解析的数据长度
+   * 流式处理chunk时已经解析的数据会在Decode结束时被Compact回收，只有未解析的数据多到Compact腾不出空间时才扩容，
+   * 否则对端持续写满缓冲区时每次读取都会扩容，缓冲区会增长到整个上传的大小
+   */
+  void growIfFull( uint32_t needDecodeLen )
+  {
+    if ( pkt_.Len() > 0 ) {
+      return;
+    }
+    if ( chunk_streaming_ && needDecodeLen <= pkt_.UseLen() - needDecodeLen ) {
+      return;
+    }
+    reAlloc( pkt_.UseLen() * 2 );
+  }
+
+  // 接收缓冲区扩容，已经解析出的视图需要跟着调整到新的地址
+  void reAlloc( size_t len )
+  {
+    const uint8_t* oldBase = pkt_.DataRaw();
+    pkt_.ReAlloc( len );
+    // 流式处理chunk时，消息中的视图指向的是消息自己持有的缓冲区，不需要调整
+    if ( pkt_.DataRaw() != oldBase && message_ != nullptr && !chunk_streaming_ ) {
+      message_->Rebase( oldBase, pkt_.DataRaw() );
+    }
+  }
+
+  static std::string_view toView( const uint8_t* begin, const uint8_t* end )
+  {
+    return { reinterpret_cast<const char*>( begin ), static_cast<size_t>( end - begin ) };
+  }
+
+  // 一个chunk编码之后的长度：16进制的大小，"\r\n"，数据，"\r\n"
+  static size_t chunkLen( size_t len )
+  {
+    size_t hexLen = 1;
+    for ( size_t i = len >> 4; i > 0; i >>= 4 ) {
+      ++hexLen;
+    }
+    return hexLen + 2 + len + 2;
+  }
+
+  static void appendChunk( Packet& pkt, std::string_view chunk )
+  {
+    char size[16];
+    auto [ptr, ec] = std::to_chars( size, size + sizeof( size ), chunk.size(), 16 );
+    append( pkt, std::string_view( size, ptr - size ) );
+    append( pkt, "\r\n" );
+    append( pkt, chunk );
+    append( pkt, "\r\n" );
+  }
+
+  static void append( Packet& pkt, std::string_view str )
+  {
+    if ( str.empty() ) {
+      return;
+    }
+    memcpy( pkt.Data(), str.data(), str.size() );
+    pkt.UpdateUseLen( str.size() );
+  }
+
 private:
   HttpDecodeStatus decode_status_ { FIRST_LINE }; // 当前解析状态
-  std::unique_ptr<HttpMessage> message_ { nullptr };
+  size_t scan_len_ { 0 };                         // 当前行已经扫描过但还没有找到行结束的长度
+  size_t message_offset_ { 0 };                   // 正在解析的消息在接收缓冲区中的起始偏移
+  std::unique_ptr<HttpMessage> message_ { nullptr };       // 正在解析的消息
+  std::queue<std::unique_ptr<HttpMessage>> messages_;      // 解析完成，等待取出的消息
+  uint64_t decode_seq_ { 0 };                              // 最后一个解析完成的请求的序号
+  uint64_t encode_seq_ { 1 };                              // 下一个需要发送的应答的序号
+  std::map<uint64_t, Packet> pending_responses_;           // 还没轮到发送的应答，按序号排列
+  size_t max_pending_responses_ { MAX_PENDING_RESPONSES }; // 缓存的应答最大个数
+  ChunkHandler chunk_handler_ { nullptr };                 // chunked编码的body的流式处理函数，为空时缓存整个body
+  bool chunk_streaming_ { false };                         // 当前消息是否在流式处理chunk
+  size_t chunk_body_offset_ { 0 };                         // 缓存模式下body在接收缓冲区中的偏移
+  uint64_t chunk_body_len_ { 0 };                          // 缓存模式下已经拼接的body长度
+  uint64_t chunk_left_ { 0 };                              // 当前chunk还没有处理的数据长度
   uint32_t max_first_line_len_ { MAX_FIRST_LINE_LEN };
   uint32_t max_header_len_ { MAX_HEADER_LEN };
   uint32_t max_body_len_ { MAX_BODY_LEN };
@@ -1,27 +1,92 @@
 #pragma once
 
-#include <map>
+#include <strings.h>
+
+#include <list>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "packet.hpp"
+
 namespace Protocol {
+constexpr uint32_t HTTP_INLINE_HEADER_COUNT = 16; // 内联存放的header个数，超过之后才使用堆内存
+constexpr std::string_view HTTP_CONTENT_TYPE_JSON = "application/json";           // body为json
+constexpr std::string_view HTTP_CONTENT_TYPE_PROTOBUF = "application/x-protobuf"; // body为pb序列化后的二进制
+
 // 目前只支持4个状态码
 enum HttpStatusCode
 {
   OK = 200,                    // 请求成功
-  BAD_REQUEST = 400,           // 错误的请求，目前body只支持json格式，非json格式返回这个错误码
+  BAD_REQUEST = 400,           // 错误的请求，body只支持json和protobuf二进制，其它格式返回这个错误码
   NOT_FOUND = 404,             // 请求失败，未找到相关资源
   INTERNAL_SERVER_ERROR = 500, // 内部服务错误
 };
 
+struct HttpHeader
+{
+  std::string_view key_;
+  std::string_view value_;
+};
+
+/* http消息，first_line_，header和body_都是视图
+ * 解码得到的消息，视图指向消息持有的接收缓冲区buf_，解析过程中不产生任何拷贝
+ * 编码用的消息，通过SetXXX设置的内容保存在storage_中
+ */
 struct HttpMessage
 {
-  void SetHeader( const std::string& key, const std::string& value ) { headers_[key] = value; }
-  void SetBody( const std::string& body )
+  HttpMessage() = default;
+  HttpMessage( const HttpMessage& ) = delete;
+  HttpMessage& operator=( const HttpMessage& ) = delete;
+
+  void SetHeader( const std::string& key, const std::string& value )
   {
-    body_ = body;
-    SetHeader( "Content-Type", "application/json" );
+    std::string_view ownValue = store( value );
+    if ( size_t index = findHeader( key ); index < header_count_ ) {
+      header( index ).value_ = ownValue;
+      return;
+    }
+    AddHeader( store( key ), ownValue );
+  }
+
+  /* 传入右值时直接接管body的内存，不需要拷贝
+   * 使用Content-Length发送，之前设置的chunked编码会被取消，需要chunked时在SetBody之后调用SetChunked
+   */
+  void SetBody( std::string body, std::string_view contentType = HTTP_CONTENT_TYPE_JSON )
+  {
+    RemoveHeader( "Transfer-Encoding" );
+    body_ = store( std::move( body ) );
+    SetHeader( "Content-Type", std::string( contentType ) );
     SetHeader( "Content-Length", std::to_string( body_.length() ) );
   }
 
+  // body是否为protobuf二进制，由Content-Type决定，没有Content-Type时按json处理
+  bool BodyIsProtobuf() const { return isProtobuf( GetHeader( "Content-Type" ) ); }
+
+  /* 应答是否使用protobuf二进制，由Accept决定，没有Accept时和请求body的格式保持一致
+   * 没有Content-Type的请求（例如GET）只看Accept
+   */
+  bool AcceptProtobuf() const
+  {
+    std::string_view accept = GetHeader( "Accept" );
+    if ( accept.empty() ) {
+      return BodyIsProtobuf();
+    }
+    return isProtobuf( accept );
+  }
+
+  // 拷贝之后设置第一行，用于解码时无法直接引用接收缓冲区的场景，例如HTTP/2的header经过了HPACK编码
+  void SetFirstLine( std::string_view firstLine ) { first_line_ = store( firstLine ); }
+
+  // 使用chunked编码发送body，Content-Length和chunked不能同时存在，已经设置的body_作为第一个chunk发送
+  void SetChunked()
+  {
+    RemoveHeader( "Content-Length" );
+    SetHeader( "Transfer-Encoding", "chunked" );
+  }
+  bool IsChunked() const { return GetHeader( "Transfer-Encoding" ).find( "chunked" ) != std::string_view::npos; }
+
   void SetStatusCode( HttpStatusCode statusCode )
   {
     if ( OK == statusCode ) {
@@ -35,34 +100,134 @@ struct HttpMessage
     }
   }
 
-  std::string GetHeader( const std::string& key )
+  // header的key不区分大小写，不存在时返回空串
+  std::string_view GetHeader( std::string_view key ) const
   {
-    if ( headers_.find( key ) == headers_.end() ) {
-      return "";
+    size_t index = findHeader( key );
+    if ( index >= header_count_ ) {
+      return {};
     }
-    return headers_[key];
+    return Header( index ).value_;
   }
-  void GetMethodAndUrl( std::string& method, std::string& url )
+
+  void GetMethodAndUrl( std::string& method, std::string& url ) const
   {
-    int32_t spaceCount = 0;
-    for ( char c : first_line_ ) {
-      if ( c == ' ' ) {
-        spaceCount++;
-        continue;
-      }
-      if ( spaceCount == 0 ) {
-        method += c;
-      }
-      if ( spaceCount == 1 ) {
-        url += c;
+    std::string_view methodView;
+    std::string_view urlView;
+    GetMethodAndUrl( methodView, urlView );
+    method = methodView;
+    url = urlView;
+  }
+
+  void GetMethodAndUrl( std::string_view& method, std::string_view& url ) const
+  {
+    size_t methodEnd = first_line_.find( ' ' );
+    if ( std::string_view::npos == methodEnd ) {
+      method = first_line_;
+      return;
+    }
+    method = first_line_.substr( 0, methodEnd );
+    size_t urlEnd = first_line_.find( ' ', methodEnd + 1 );
+    url = first_line_.substr( methodEnd + 1, urlEnd - methodEnd - 1 );
+  }
+
+  // 追加一个header，不检查是否重复，key和value的内容需要由调用方保证有效
+  void AddHeader( std::string_view key, std::string_view value )
+  {
+    if ( header_count_ < HTTP_INLINE_HEADER_COUNT ) {
+      headers_[header_count_] = { key, value };
+    } else {
+      more_headers_.push_back( { key, value } );
+    }
+    ++header_count_;
+  }
+
+  // 删除header，后面的header依次前移，保持原有的顺序，不存在时什么都不做
+  void RemoveHeader( std::string_view key )
+  {
+    size_t index = findHeader( key );
+    if ( index >= header_count_ ) {
+      return;
+    }
+    for ( size_t i = index + 1; i < header_count_; ++i ) {
+      header( i - 1 ) = Header( i );
+    }
+    if ( header_count_ > HTTP_INLINE_HEADER_COUNT ) {
+      more_headers_.pop_back();
+    }
+    --header_count_;
+  }
+
+  // 拷贝key和value之后追加header，不检查是否重复
+  void AppendHeader( std::string_view key, std::string_view value ) { AddHeader( store( key ), store( value ) ); }
+
+  size_t HeaderCount() const { return header_count_; }
+  const HttpHeader& Header( size_t index ) const
+  {
+    if ( index < HTTP_INLINE_HEADER_COUNT ) {
+      return headers_[index];
+    }
+    return more_headers_[index - HTTP_INLINE_HEADER_COUNT];
+  }
+
+  // 接收缓冲区扩容之后地址发生了变化，把指向旧缓冲区的视图调整到新缓冲区
+  void Rebase( const uint8_t* oldBase, const uint8_t* newBase )
+  {
+    auto rebase = [oldBase, newBase]( std::string_view& view ) {
+      if ( view.empty() ) {
+        return;
       }
+      auto offset = reinterpret_cast<const uint8_t*>( view.data() ) - oldBase;
+      view = std::string_view( reinterpret_cast<const char*>( newBase + offset ), view.size() );
+    };
+    rebase( first_line_ );
+    rebase( body_ );
+    for ( size_t i = 0; i < header_count_; ++i ) {
+      rebase( header( i ).key_ );
+      rebase( header( i ).value_ );
     }
   }
 
   // 对于请求来说是request_line，对于应答来说是status_line
-  std::string first_line_;
-  std::map<std::string, std::string> headers_;
-  std::string body_;
+  std::string_view first_line_;
+  std::string_view body_;
+  Packet buf_;        // 解码得到的消息持有的接收缓冲区
+  uint64_t seq_ { 0 }; // 请求在连接上的序号，从1开始，应答需要设置为对应请求的序号才能按顺序发送
+
+private:
+  HttpHeader& header( size_t index )
+  {
+    if ( index < HTTP_INLINE_HEADER_COUNT ) {
+      return headers_[index];
+    }
+    return more_headers_[index - HTTP_INLINE_HEADER_COUNT];
+  }
+
+  // 查找header的下标，不存在时返回header_count_
+  size_t findHeader( std::string_view key ) const
+  {
+    for ( size_t i = 0; i < header_count_; ++i ) {
+      const HttpHeader& header = Header( i );
+      if ( header.key_.size() == key.size() && 0 == strncasecmp( header.key_.data(), key.data(), key.size() ) ) {
+        return i;
+      }
+    }
+    return header_count_;
+  }
+
+  // 只做子串匹配，忽略"; charset=..."之类的参数，Accept中有多个类型时只要包含了protobuf就认为接受
+  static bool isProtobuf( std::string_view contentType )
+  {
+    return contentType.find( HTTP_CONTENT_TYPE_PROTOBUF ) != std::string_view::npos;
+  }
+
+  std::string_view store( std::string_view str ) { return storage_.emplace_back( str ); }
+  std::string_view store( std::string&& str ) { return storage_.emplace_back( std::move( str ) ); }
+
+  HttpHeader headers_[HTTP_INLINE_HEADER_COUNT];
+  std::vector<HttpHeader> more_headers_; // 超过内联个数的header
+  size_t header_count_ { 0 };
+  std::list<std::string> storage_; // SetXXX设置的内容，list追加元素不会使已有元素失效
 };
 
 } // namespace Protocol
\ No newline at end of file
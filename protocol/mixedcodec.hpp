@@ -2,18 +2,43 @@
 
 #include "common/convert.hpp"
 #include "common/statuscode.hpp"
+#include "http2codec.hpp"
 #include "httpcodec.hpp"
 #include "mysvrcodec.hpp"
 #include "protocol/codec.hpp"
 #include "protocol/httpmessage.hpp"
 #include "protocol/mysvrmessage.hpp"
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace Protocol {
+constexpr uint32_t SNIFF_READ_LEN = 4 * 1024; // 确定协议之前第一次读取的数据量
+
+using CodecFactory = std::unique_ptr<Codec> ( * )();
+
+// 协议探测表的一项，读取到的数据以prefix_开头时使用factory_创建codec
+struct CodecSniffer
+{
+  std::string prefix_;
+  CodecFactory factory_;
+};
+
+// 根据连接上最开始的数据选择具体的协议，之后的编解码都交给选中的codec
 class MixedCodec : public Codec
 {
 public:
+  MixedCodec() { pkt_.Alloc( SNIFF_READ_LEN ); }
+
+  /* 注册新的协议，例如RESP的"*"，需要在处理连接之前完成注册，按照注册的顺序匹配，先匹配上的优先
+   * 默认已经注册了MySvr的魔数，HTTP/2的连接前言以及常见的HTTP方法
+   */
+  static void RegisterCodec( std::string prefix, CodecFactory factory )
+  {
+    sniffers().push_back( { std::move( prefix ), factory } );
+  }
+
   CodecType Type() override
   {
     if ( nullptr == codec_ ) {
@@ -24,18 +49,16 @@ public:
 
   uint8_t* Data()
   {
-    // 无法确定具体协议之前，只读取一个字节
     if ( nullptr == codec_ ) {
-      return &first_byte_;
+      return pkt_.Data();
     }
     return codec_->Data();
   }
 
   size_t Len()
   {
-    // 无法确定具体协议之前，只读取一个字节
     if ( nullptr == codec_ ) {
-      return 1;
+      return pkt_.Len();
     }
     return codec_->Len();
   }
@@ -56,22 +79,47 @@ public:
     return codec_->Encode( msg, pkt );
   }
 
+  bool TakeOutput( Packet& pkt ) override
+  {
+    if ( nullptr == codec_ ) {
+      return false;
+    }
+    return codec_->TakeOutput( pkt );
+  }
+
   bool Decode( size_t len ) override
   {
     assert( len >= 1 );
-    createCodec();
-    assert( codec_ != nullptr );
-    return codec_->Decode( len );
+    if ( codec_ != nullptr ) {
+      return codec_->Decode( len );
+    }
+    pkt_.UpdateUseLen( len );
+    if ( !createCodec() ) {
+      return false;
+    }
+    if ( nullptr == codec_ ) {
+      return true; // 数据还不足以确定协议
+    }
+    // 已经读取的数据直接交给选中的codec，不需要拷贝
+    codec_->TakeOver( pkt_ );
+    pkt_ = Packet();
+    return codec_->Decode( 0 );
   }
 
   static void Http2MySvr( HttpMessage& httpMessage, MySvrMessage& mySvrMessage )
   {
-    mySvrMessage.context_.set_service_name( httpMessage.GetHeader( "service_name" ) );
-    mySvrMessage.context_.set_rpc_name( httpMessage.GetHeader( "rpc_name" ) );
-    mySvrMessage.BodyEnableJson(); // body的格式设置为json
+    mySvrMessage.context_.set_service_name( std::string( httpMessage.GetHeader( "service_name" ) ) );
+    mySvrMessage.context_.set_rpc_name( std::string( httpMessage.GetHeader( "rpc_name" ) ) );
+    // MySvr只用一个标志位描述body的格式，应答和请求一致，body为空时（例如GET）才能按Accept选择应答的格式
+    bool isProtobuf = httpMessage.body_.empty() ? httpMessage.AcceptProtobuf() : httpMessage.BodyIsProtobuf();
+    if ( !isProtobuf ) {
+      mySvrMessage.BodyEnableJson(); // body的格式设置为json
+    }
     size_t bodyLen = httpMessage.body_.size();
     mySvrMessage.body_.Alloc( bodyLen );
-    memmove( mySvrMessage.body_.Data(), httpMessage.body_.data(), bodyLen );
+    if ( bodyLen > 0 ) { // GET之类的请求没有body
+      memmove( mySvrMessage.body_.Data(), httpMessage.body_.data(), bodyLen );
+    }
     mySvrMessage.body_.UpdateUseLen( bodyLen );
   }
 
@@ -81,41 +129,81 @@ public:
     httpMessage.SetHeader( "log_id", mySvrMessage.context_.log_id() );
     httpMessage.SetHeader( "status_code", std::to_string( mySvrMessage.context_.status_code() ) );
     if ( 0 == mySvrMessage.context_.status_code() ) {
-      assert( mySvrMessage.BodyIsJson() ); // body此时必须是json str
       size_t len = mySvrMessage.body_.UseLen();
-      httpMessage.SetBody( std::string( reinterpret_cast<char*>( mySvrMessage.body_.DataRaw() ), len ) );
+      std::string body( reinterpret_cast<char*>( mySvrMessage.body_.DataRaw() ), len );
+      if ( mySvrMessage.BodyIsJson() ) {
+        httpMessage.SetBody( std::move( body ) );
+      } else { // 二进制直接透传，不做json转换
+        httpMessage.SetBody( std::move( body ), HTTP_CONTENT_TYPE_PROTOBUF );
+      }
     } else {
       httpMessage.SetBody( R"({"message":")" + mySvrMessage.Message() + R"("})" );
     }
   }
 
+  // http请求直接解析到pb中，body直接从接收缓冲区中解析，不经过MySvrMessage中转，Content-Type决定body的格式
+  static bool PbParseFromHttp( google::protobuf::Message& pb, HttpMessage& http )
+  {
+    if ( http.BodyIsProtobuf() ) {
+      return pb.ParseFromArray( http.body_.data(), static_cast<int>( http.body_.size() ) );
+    }
+    return Common::Convert::JsonStr2Pb( http.body_, pb );
+  }
+
+  /* pb直接序列化成http应答，序列化结果的内存直接交给应答消息，不经过MySvrMessage中转
+   * isProtobuf一般传入请求的AcceptProtobuf()，为true时body为pb二进制，跳过json转换
+   */
+  static void PbSerializeToHttp( google::protobuf::Message& pb,
+                                 HttpMessage& http,
+                                 int statusCode,
+                                 const std::string& logId,
+                                 bool isProtobuf = false )
+  {
+    std::string body;
+    bool ok = isProtobuf ? pb.SerializeToString( &body ) : Common::Convert::Pb2JsonStr( pb, body );
+    if ( !ok ) {
+      statusCode = SERIALIZE_FAILED;
+    }
+    http.SetStatusCode( OK );
+    http.SetHeader( "log_id", logId );
+    http.SetHeader( "status_code", std::to_string( statusCode ) );
+    if ( 0 == statusCode ) {
+      http.SetBody( std::move( body ), isProtobuf ? HTTP_CONTENT_TYPE_PROTOBUF : HTTP_CONTENT_TYPE_JSON );
+    } else { // 错误信息统一使用json
+      http.SetBody( R"({"message":")" + STATUS_CODE.Message( statusCode ) + R"("})" );
+    }
+  }
+
   static bool PbParseFromMySvr( google::protobuf::Message& pb, MySvrMessage& mySvr )
   {
-    std::string str( reinterpret_cast<char*>( mySvr.body_.DataRaw() ), mySvr.body_.UseLen() );
+    const uint8_t* data = mySvr.body_.DataRaw();
+    size_t len = mySvr.body_.UseLen();
     if ( mySvr.BodyIsJson() ) { // json格式
-      return Common::Convert::JsonStr2Pb( str, pb );
+      return Common::Convert::JsonStr2Pb( std::string_view( reinterpret_cast<const char*>( data ), len ), pb );
     }
-    return pb.ParseFromString( str );
+    return pb.ParseFromArray( data, static_cast<int>( len ) );
   }
 
   static void PbSerializeToMySvr( google::protobuf::Message& pb, MySvrMessage& mySvr, int statusCode )
   {
-    std::string str;
-    bool result = true;
     if ( mySvr.BodyIsJson() ) { // json格式
-      result = Common::Convert::Pb2JsonStr( pb, str );
-    } else {
-      result = pb.SerializeToString( &str );
-    }
-
-    if ( !result ) {
-      mySvr.context_.set_status_code( SERIALIZE_FAILED );
-      return;
+      std::string str;
+      if ( !Common::Convert::Pb2JsonStr( pb, str ) ) {
+        mySvr.context_.set_status_code( SERIALIZE_FAILED );
+        return;
+      }
+      mySvr.body_.Alloc( str.size() );
+      memmove( mySvr.body_.Data(), str.data(), str.size() );
+      mySvr.body_.UpdateUseLen( str.size() );
+    } else { // 二进制直接序列化到body中
+      size_t size = pb.ByteSizeLong();
+      mySvr.body_.Alloc( size );
+      if ( !pb.SerializeToArray( mySvr.body_.Data(), static_cast<int>( size ) ) ) {
+        mySvr.context_.set_status_code( SERIALIZE_FAILED );
+        return;
+      }
+      mySvr.body_.UpdateUseLen( size );
     }
-
-    mySvr.body_.Alloc( str.size() );
-    memmove( mySvr.body_.Data(), str.data(), str.size() );
-    mySvr.body_.UpdateUseLen( str.size() );
     mySvr.context_.set_status_code( statusCode );
   }
 
@@ -133,23 +221,54 @@ public:
   }
 
 private:
-  void createCodec()
+  // 根据已经读取的数据选择codec，数据还不足以确定协议时codec_为空，所有的协议都不匹配时返回false
+  bool createCodec()
   {
-    if ( codec_ != nullptr ) {
-      return;
+    const uint8_t* data = pkt_.DataRaw();
+    size_t len = pkt_.UseLen();
+    bool needMore = false;
+    for ( const CodecSniffer& sniffer : sniffers() ) {
+      size_t cmpLen = std::min( len, sniffer.prefix_.size() );
+      if ( 0 != memcmp( data, sniffer.prefix_.data(), cmpLen ) ) {
+        continue;
+      }
+      if ( cmpLen == sniffer.prefix_.size() ) {
+        codec_ = sniffer.factory_();
+        return true;
+      }
+      needMore = true;
     }
-
-    if ( PROTO_MAGIC_AND_VERSION == first_byte_ ) {
-      codec_ = std::make_unique<MySvrCodec>();
-    } else {
-      codec_ = std::make_unique<HttpCodec>();
+    if ( !needMore ) {
+      ERROR( "unknown protocol, first byte[0x%02x]", data[0] );
     }
-    memmove( codec_->Data(), &first_byte_, 1 ); // 拷贝1个字节的内容
-    first_byte_ = 0;
+    return needMore;
+  }
+
+  static std::vector<CodecSniffer>& sniffers()
+  {
+    static std::vector<CodecSniffer> sniffers = {
+      { std::string( 1, static_cast<char>( PROTO_MAGIC_AND_VERSION ) ), makeCodec<MySvrCodec> },
+      { H2_PREFACE, makeCodec<Http2Codec> },
+      { "GET ", makeCodec<HttpCodec> },
+      { "POST ", makeCodec<HttpCodec> },
+      { "PUT ", makeCodec<HttpCodec> },
+      { "DELETE ", makeCodec<HttpCodec> },
+      { "HEAD ", makeCodec<HttpCodec> },
+      { "OPTIONS ", makeCodec<HttpCodec> },
+      { "PATCH ", makeCodec<HttpCodec> },
+      { "TRACE ", makeCodec<HttpCodec> },
+      { "CONNECT ", makeCodec<HttpCodec> },
+    };
+    return sniffers;
+  }
+
+  template <typename T>
+  static std::unique_ptr<Codec> makeCodec()
+  {
+    return std::make_unique<T>();
   }
 
   std::unique_ptr<Codec> codec_ { nullptr };
-  uint8_t first_byte_ { 0 };
 };
 
 } // namespace Protocol
\ No newline at end of file
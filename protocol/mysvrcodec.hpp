@@ -1,20 +1,29 @@
 #pragma once
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cstring>
 #include <memory>
 #include <netinet/in.h>
+#include <queue>
 #include <snappy.h>
+#include <sys/uio.h>
 
 #include <string>
+#include <vector>
 
 #include "codec.hpp"
+#include "compress.hpp"
 #include "mysvrmessage.hpp"
 #include "protocol/packet.hpp"
 
 namespace Protocol {
 constexpr uint32_t MY_SVR_MAX_CONTEXT_LEN = 64 * 1024;     // 消息上下文最大长度
 constexpr uint32_t MY_SVR_MAX_BODY_LEN = 20 * 1024 * 1024; // 消息体最大长度
+constexpr uint32_t MY_SVR_COMPRESS_MIN_LEN = 0;            // 默认所有消息都压缩，旧版本对端总是按snappy解压
+constexpr uint32_t MY_SVR_READ_LEN = 4 * 1024;             // 每次至少可以读取的数据量，用于一次读取多个流水线消息
+constexpr size_t MY_SVR_ARENA_START_BLOCK_LEN = 4 * 1024;  // arena的第一个内存块大小，一般的rpc一个块就够用
+constexpr size_t MY_SVR_ARENA_MAX_BLOCK_LEN = 64 * 1024;   // arena扩容时单个内存块的最大大小
 
 // 解码状态
 enum MySvrDecodeStatus
@@ -29,21 +38,20 @@ enum MySvrDecodeStatus
 class MySvrCodec : public Codec
 {
 public:
-  MySvrCodec() { pkt_.Alloc( PROTO_HEAD_LEN ); }
+  MySvrCodec() { pkt_.Alloc( MY_SVR_READ_LEN ); }
   ~MySvrCodec() override = default;
 
   CodecType Type() override { return MY_SVR; }
 
+  // 一次Decode可能解析出多个消息，需要循环调用直到返回nullptr，消息按照接收的顺序返回
   void* GetMessage() override
   {
-    if ( nullptr == message_ ) {
+    if ( messages_.empty() ) {
       return nullptr;
     }
-    if ( decode_status_ != MY_SVR_FINISH ) {
-      return nullptr;
-    }
-    decode_status_ = MY_SVR_HEAD; // 消息被取出之后解析状态设置为HEAD
-    return message_.release();
+    MySvrMessage* message = messages_.front().release();
+    messages_.pop();
+    return message;
   }
 
   void SetLimit( uint32_t maxContextLen, uint32_t maxBodyLen )
@@ -52,44 +60,74 @@ public:
     max_body_len_ = maxBodyLen;
   }
 
+  /* 开启之后，每个解码出来的请求都带有一个新的arena，context_直接反序列化到arena上，
+   * 业务通过请求的CreatePb创建请求和应答pb，通过MySvrMessage( request.arena_ )构造应答，整个rpc共用这个arena
+   */
+  void EnableArena( size_t startBlockLen = MY_SVR_ARENA_START_BLOCK_LEN,
+                    size_t maxBlockLen = MY_SVR_ARENA_MAX_BLOCK_LEN )
+  {
+    enable_arena_ = true;
+    arena_options_.start_block_size = startBlockLen;
+    arena_options_.max_block_size = std::max( startBlockLen, maxBlockLen );
+  }
+
+  /* 设置编码时使用的压缩算法，以及启用压缩的消息体最小长度，小于该长度的消息原样发送
+   * 默认所有消息都用snappy压缩。旧版本不识别flag_中的压缩类型，总是按snappy解压context和body，
+   * 所以原样发送（compressMinLen大于0）以及lz4、zstd都需要所有对端升级之后才能开启
+   */
+  bool SetCompress( uint8_t compressType, uint32_t compressMinLen )
+  {
+    if ( !Compressor::IsSupport( compressType ) ) {
+      return false;
+    }
+    compress_type_ = compressType;
+    compress_min_len_ = compressMinLen;
+    return true;
+  }
+
   bool Encode( void* msg, Packet& pkt ) override
   {
     MySvrMessage& message = *static_cast<MySvrMessage*>( msg );
-    std::string body( reinterpret_cast<const char*>( message.body_.DataRaw() ), message.body_.UseLen() );
-    std::string context;
-    std::string compressBody;
-    std::string compressContext;
-    if ( !message.context_.SerializePartialToString( &context ) ) {
+    if ( !encodeToBuf( message ) ) {
       return false;
     }
-    snappy::Compress( body.data(), body.size(), &compressBody );
-    snappy::Compress( context.data(), context.size(), &compressContext );
-    message.head_.context_len_ = compressContext.size();                                // 设置消息上下文的长度
-    message.head_.body_len_ = compressBody.size();                                      // 设置消息体的长度
     size_t len = PROTO_HEAD_LEN + message.head_.context_len_ + message.head_.body_len_; // 计算包总长度
     pkt.Alloc( len );                                                                   // 分配空间
-    encodeHead( message, pkt );                                                         // 打包消息头
-    pkt.UpdateUseLen( PROTO_HEAD_LEN );
-    memmove( pkt.Data(), compressContext.data(), compressContext.size() ); // 打包消息上下文
-    pkt.UpdateUseLen( compressContext.size() );
-    memmove( pkt.Data(), compressBody.data(), compressBody.size() ); // 打包消息体
-    pkt.UpdateUseLen( compressBody.size() );
+    for ( const auto& iov : iov_ ) { // 依次打包消息头，消息上下文，消息体
+      if ( 0 == iov.iov_len ) {
+        continue;
+      }
+      memmove( pkt.Data(), iov.iov_base, iov.iov_len );
+      pkt.UpdateUseLen( iov.iov_len );
+    }
+    return true;
+  }
+
+  // 分散写编码，iov中依次为消息头、压缩后的消息上下文、压缩后的消息体，可以直接交给writev发送。
+  // iov引用的是codec内部复用的缓冲区（不压缩时直接引用消息体），在下一次编码之前有效。
+  bool EncodeIov( void* msg, std::vector<struct iovec>& iov )
+  {
+    MySvrMessage& message = *static_cast<MySvrMessage*>( msg );
+    if ( !encodeToBuf( message ) ) {
+      return false;
+    }
+    iov.assign( std::begin( iov_ ), std::end( iov_ ) );
     return true;
   }
 
   bool Decode( size_t len ) override
   {
-    pkt_.UpdateParseLen( len );
+    pkt_.UpdateUseLen( len );
     uint32_t decodeLen = 0;
     uint32_t needDecodeLen = pkt_.NeedParseLen();
     uint8_t* data = pkt_.DataParse();
-    if ( nullptr == message_ ) {
-      message_ = std::make_unique<MySvrMessage>();
-    }
 
-    // 只要还有未解析的网络字节流，就持续解析
-    while ( needDecodeLen > 0 ) {
+    // 只要还有未解析的网络字节流，就持续解析，一次读取到的多个完整消息都解析到就绪队列中
+    while ( true ) {
       bool decodeBreak = false;
+      if ( nullptr == message_ ) {
+        message_ = newMessage();
+      }
 
       if ( MY_SVR_HEAD == decode_status_ ) { // 解析消息头
         if ( !decodeHead( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
@@ -120,29 +158,85 @@ public:
           break;
         }
       }
+
+      if ( MY_SVR_FINISH == decode_status_ ) { // 完成一个消息的解析，放入就绪队列，继续解析下一个消息
+        messages_.push( std::move( message_ ) );
+        decode_status_ = MY_SVR_HEAD;
+      }
     }
 
     if ( decodeLen > 0 ) {
       pkt_.UpdateParseLen( decodeLen );
     }
+    // 保留未解析完的数据，回收已解析的空间，再保证缓冲区能容纳当前消息剩余的部分
+    pkt_.Compact();
+    if ( 0 == pkt_.UseLen() ) {
+      pkt_.Alloc( MY_SVR_READ_LEN ); // 没有待解析的数据，及时释放处理大消息时扩容的空间
+    }
+    pkt_.ReAlloc( pkt_.ParseLen() + std::max<size_t>( needFrameLen(), MY_SVR_READ_LEN ) );
+    return true;
+  }
+
+private:
+  // 序列化并压缩消息上下文和消息体到复用的缓冲区中，同时打包好消息头，结果存放在iov_中
+  bool encodeToBuf( MySvrMessage& message )
+  {
+    size_t contextLen = message.context_.ByteSizeLong();
+    context_buf_.Alloc( contextLen );
+    if ( !message.context_.SerializePartialToArray( context_buf_.Data(), static_cast<int>( contextLen ) ) ) {
+      return false;
+    }
+    context_buf_.UpdateUseLen( contextLen );
 
-    if ( MY_SVR_FINISH == decode_status_ ) {
-      pkt_.Alloc( PROTO_HEAD_LEN ); // 解析完一个消息及时释放空间，并申请协议头部需要的空间
+    // 小消息压缩的cpu开销比节省的带宽更大，开启了阈值时直接原样发送
+    uint8_t compressType
+      = message.body_.UseLen() < compress_min_len_ ? static_cast<uint8_t>( COMPRESS_NONE ) : compress_type_;
+    message.SetCompressType( compressType );
+    iov_[1] = toIov( context_buf_ );
+    iov_[2] = toIov( message.body_ );
+    if ( compressType != COMPRESS_NONE ) {
+      if ( !Compressor::Compress( compressType, context_buf_.DataRaw(), context_buf_.UseLen(), compress_context_ ) ) {
+        return false;
+      }
+      if ( !Compressor::Compress( compressType, message.body_.DataRaw(), message.body_.UseLen(), compress_body_ ) ) {
+        return false;
+      }
+      iov_[1] = toIov( compress_context_ );
+      iov_[2] = toIov( compress_body_ );
+    }
+    if ( iov_[1].iov_len > UINT16_MAX ) { // 消息上下文长度只有2个字节
+      return false;
     }
 
+    message.head_.context_len_ = iov_[1].iov_len; // 设置消息上下文的长度
+    message.head_.body_len_ = iov_[2].iov_len;    // 设置消息体的长度
+    encodeHead( message, head_buf_ );             // 打包消息头
+    iov_[0].iov_base = head_buf_;
+    iov_[0].iov_len = PROTO_HEAD_LEN;
     return true;
   }
 
-private:
-  void encodeHead( MySvrMessage& message, Packet& pkt )
+  std::unique_ptr<MySvrMessage> newMessage() const
+  {
+    if ( !enable_arena_ ) {
+      return std::make_unique<MySvrMessage>();
+    }
+    return std::make_unique<MySvrMessage>( std::make_shared<google::protobuf::Arena>( arena_options_ ) );
+  }
+
+  static struct iovec toIov( Packet& pkt ) { return { pkt.DataRaw(), pkt.UseLen() }; }
+
+  static void encodeHead( MySvrMessage& message, uint8_t* data )
   {
-    uint8_t* data = pkt.Data();
     *data = message.head_.magic_and_version_; // 设置协议魔数和版本号
     ++data;
     *data = message.head_.flag_; // 设置协议flag
     ++data;
-    *reinterpret_cast<uint16_t*>( data ) = htons( message.head_.context_len_ ); // 设置消息上下文长度
-    *reinterpret_cast<uint32_t*>( data ) = htonl( message.head_.body_len_ );    // 设置消息体长度
+    uint16_t contextLen = htons( message.head_.context_len_ );
+    memcpy( data, &contextLen, sizeof( contextLen ) ); // 设置消息上下文长度
+    data += sizeof( contextLen );
+    uint32_t bodyLen = htonl( message.head_.body_len_ );
+    memcpy( data, &bodyLen, sizeof( bodyLen ) ); // 设置消息体长度
   }
 
   bool decodeHead( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
@@ -161,22 +255,29 @@ private:
     curData++;
     message_->head_.flag_ = *curData;
     curData++;
-    message_->head_.context_len_ = ntohs( *reinterpret_cast<uint16_t*>( curData ) ); // 解析消息上下文长度
-    curData += 2;
-    message_->head_.body_len_ = ntohl( *reinterpret_cast<uint32_t*>( curData ) ); // 解析消息体长度
-    if ( message_->head_.context_len_ > max_body_len_ ) {
+    // 流水线消息的起始地址不一定是对齐的，使用memcpy读取
+    uint16_t contextLen = 0;
+    memcpy( &contextLen, curData, sizeof( contextLen ) );
+    message_->head_.context_len_ = ntohs( contextLen ); // 解析消息上下文长度
+    curData += sizeof( contextLen );
+    uint32_t bodyLen = 0;
+    memcpy( &bodyLen, curData, sizeof( bodyLen ) );
+    message_->head_.body_len_ = ntohl( bodyLen ); // 解析消息体长度
+    if ( message_->head_.context_len_ > max_content_len_ ) {
       return false;
     }
     if ( message_->head_.body_len_ > max_body_len_ ) {
       return false;
     }
+    if ( !Compressor::IsSupport( message_->CompressType() ) ) {
+      // 不支持的压缩算法，解析失败
+      return false;
+    }
     // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态
     needDecodeLen -= PROTO_HEAD_LEN;
     decodeLen += PROTO_HEAD_LEN;
     ( *data ) += PROTO_HEAD_LEN;
     decode_status_ = MY_SVR_CONTEXT;
-    // 重新分配内存空间，这样解析一个消息最多就分配两次内存
-    pkt_.ReAlloc( PROTO_HEAD_LEN + message_->head_.context_len_ + message_->head_.body_len_ );
     return true;
   }
 
@@ -188,10 +289,18 @@ private:
       return true;
     }
 
-    std::string context;
-    std::string compressContext( reinterpret_cast<const char*>( *data ), static_cast<size_t>( contextLen ) );
-    snappy::Uncompress( compressContext.data(), compressContext.size(), &context );
-    if ( !message_->context_.ParseFromString( context ) ) {
+    // 未压缩的直接从接收缓冲区反序列化，压缩的解压到解码专用的缓冲区再反序列化，不产生中间的std::string
+    // 不能复用编码的context_buf_，EncodeIov返回的iov可能还引用着它
+    const uint8_t* context = *data;
+    size_t len = contextLen;
+    if ( message_->CompressType() != COMPRESS_NONE ) {
+      if ( !Compressor::Uncompress( message_->CompressType(), *data, contextLen, max_content_len_, uncompress_buf_ ) ) {
+        return false;
+      }
+      context = uncompress_buf_.DataRaw();
+      len = uncompress_buf_.UseLen();
+    }
+    if ( !message_->context_.ParseFromArray( context, static_cast<int>( len ) ) ) {
       return false;
     }
     // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
@@ -204,18 +313,16 @@ private:
 
   bool decodeBody( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
   {
-    decodeBreak = true; // 不管是否能完成解析都跳出循环
     uint32_t bodyLen = message_->head_.body_len_;
     if ( needDecodeLen < bodyLen ) {
+      decodeBreak = true;
       return true;
     }
 
-    std::string body;
-    std::string compressBody( reinterpret_cast<const char*>( *data ), static_cast<size_t>( bodyLen ) );
-    snappy::Uncompress( compressBody.data(), compressBody.size(), &body );
-    message_->body_.Alloc( body.size() );
-    memmove( message_->body_.Data(), body.data(), body.size() );
-    message_->body_.UpdateUseLen( body.size() );
+    // 直接从接收缓冲区解压到消息体中，一次解压，没有中间拷贝
+    if ( !Compressor::Uncompress( message_->CompressType(), *data, bodyLen, max_body_len_, message_->body_ ) ) {
+      return false;
+    }
     // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
     needDecodeLen -= bodyLen;
     decodeLen += bodyLen;
@@ -224,10 +331,33 @@ private:
     return true;
   }
 
+  // 当前正在解析的消息，从未解析的数据开始还需要的数据长度
+  size_t needFrameLen() const
+  {
+    if ( MY_SVR_CONTEXT == decode_status_ ) {
+      return message_->head_.context_len_ + message_->head_.body_len_;
+    }
+    if ( MY_SVR_BODY == decode_status_ ) {
+      return message_->head_.body_len_;
+    }
+    return PROTO_HEAD_LEN;
+  }
+
   MySvrDecodeStatus decode_status_ { MY_SVR_HEAD };
   std::unique_ptr<MySvrMessage> message_ { nullptr };
+  std::queue<std::unique_ptr<MySvrMessage>> messages_; // 已经完成解析，等待取出的消息
   uint32_t max_content_len_ { MY_SVR_MAX_CONTEXT_LEN };
   uint32_t max_body_len_ { MY_SVR_MAX_BODY_LEN };
+  uint8_t compress_type_ { COMPRESS_SNAPPY };             // 编码时使用的压缩算法
+  uint32_t compress_min_len_ { MY_SVR_COMPRESS_MIN_LEN }; // 启用压缩的消息体最小长度
+  bool enable_arena_ { false };                           // 解码出来的消息是否使用arena
+  google::protobuf::ArenaOptions arena_options_;          // 创建arena使用的参数
+  uint8_t head_buf_[PROTO_HEAD_LEN] { 0 };                // 编码时复用的消息头缓冲区
+  Packet context_buf_;                                    // 编码时复用的消息上下文序列化缓冲区
+  Packet uncompress_buf_;                                 // 解码时复用的消息上下文解压缓冲区
+  Packet compress_context_;                               // 编码时复用的消息上下文压缩缓冲区
+  Packet compress_body_;                                  // 编码时复用的消息体压缩缓冲区
+  struct iovec iov_[3] {};                                // 编码结果：消息头，消息上下文，消息体
 };
 
 } // namespace Protocol
\ No newline at end of file
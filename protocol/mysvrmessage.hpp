@@ -3,15 +3,20 @@
 #include "common/statuscode.hpp"
 #include "packet.hpp"
 #include "protocol/base.pb.h"
+#include <google/protobuf/arena.h>
+#include <memory>
+#include <utility>
 
 namespace Protocol {
 // 协议中使用的常量
-constexpr uint8_t PROTO_MAGIC = 1;               // 协议魔数
-constexpr uint8_t PROTO_VERSION = 1;             // 协议版本号
-constexpr uint32_t PROTO_HEAD_LEN = 8;           // 固定8个字节的头部
-constexpr uint8_t PROTO_FLAG_IS_JSON = 0x1;      // body是否为json
-constexpr uint8_t PROTO_FLAG_IS_ONEWAY = 0x2;    // 是否为Oneway消息
-constexpr uint8_t PROTO_FLAG_IS_FAST_RESP = 0x4; // 是否为FastResp消息
+constexpr uint8_t PROTO_MAGIC = 1;                 // 协议魔数
+constexpr uint8_t PROTO_VERSION = 1;               // 协议版本号
+constexpr uint32_t PROTO_HEAD_LEN = 8;             // 固定8个字节的头部
+constexpr uint8_t PROTO_FLAG_IS_JSON = 0x1;        // body是否为json
+constexpr uint8_t PROTO_FLAG_IS_ONEWAY = 0x2;      // 是否为Oneway消息
+constexpr uint8_t PROTO_FLAG_IS_FAST_RESP = 0x4;   // 是否为FastResp消息
+constexpr uint8_t PROTO_FLAG_COMPRESS_SHIFT = 4;   // 压缩算法类型在flag中的偏移
+constexpr uint8_t PROTO_FLAG_COMPRESS_MASK = 0x30; // 压缩算法类型在flag中的掩码（第4、5位）
 constexpr uint8_t PROTO_MAGIC_AND_VERSION = ( PROTO_MAGIC << 4 ) | PROTO_VERSION;
 
 // 协议头
@@ -23,9 +28,38 @@ struct Head
   uint32_t body_len_ { 0 };                               // 消息体序列化后的长度（压缩过的）
 };
 
-// 协议消息
+/* 协议消息
+ * 使用arena的消息，context_以及通过CreatePb创建的请求和应答pb（包括其中的string）都分配在同一个arena上，
+ * 应答通过请求的arena_构造，一次rpc只有一个arena，应答编码完成析构之后整体释放，不需要逐个字段释放
+ */
 struct MySvrMessage
 {
+  MySvrMessage() : MySvrMessage( nullptr ) {}
+  explicit MySvrMessage( std::shared_ptr<google::protobuf::Arena> arena )
+    : arena_( std::move( arena ) )
+    , context_( *google::protobuf::Arena::CreateMessage<MySvr::Base::Context>( arena_.get() ) )
+    , own_context_( nullptr == arena_ )
+  {
+  }
+  ~MySvrMessage()
+  {
+    if ( own_context_ ) {
+      delete &context_;
+    }
+  }
+  MySvrMessage( const MySvrMessage& ) = delete;
+  MySvrMessage& operator=( const MySvrMessage& ) = delete;
+
+  // 在消息的arena上创建pb，没有arena时先创建一个，返回的pb由arena释放，调用方不能delete
+  template <typename T>
+  T* CreatePb()
+  {
+    if ( nullptr == arena_ ) {
+      arena_ = std::make_shared<google::protobuf::Arena>();
+    }
+    return google::protobuf::Arena::CreateMessage<T>( arena_.get() );
+  }
+
   void CopyFrom( const MySvrMessage& message )
   {
     head_ = message.head_;
@@ -38,12 +72,22 @@ struct MySvrMessage
   void EnableOneway() { head_.flag_ |= PROTO_FLAG_IS_ONEWAY; }
   bool BodyIsJson() const { return ( head_.flag_ & PROTO_FLAG_IS_JSON ) != 0; }
   void BodyEnableJson() { head_.flag_ |= PROTO_FLAG_IS_JSON; }
+  uint8_t CompressType() const { return ( head_.flag_ & PROTO_FLAG_COMPRESS_MASK ) >> PROTO_FLAG_COMPRESS_SHIFT; }
+  void SetCompressType( uint8_t type )
+  {
+    head_.flag_ &= ~PROTO_FLAG_COMPRESS_MASK;
+    head_.flag_ |= ( type << PROTO_FLAG_COMPRESS_SHIFT ) & PROTO_FLAG_COMPRESS_MASK;
+  }
   int32_t StatusCode() const { return context_.status_code(); }
   std::string Message() const { return STATUS_CODE.Message( context_.status_code() ); }
 
-  Head head_;                    // 消息头
-  MySvr::Base::Context context_; // 消息上下文
+  std::shared_ptr<google::protobuf::Arena> arena_; // 一次rpc共享的arena，请求和应答都持有，为空时不使用arena
+  Head head_;                                      // 消息头
+  MySvr::Base::Context& context_;                  // 消息上下文，使用arena时分配在arena上
   Packet body_; // 消息体（字节流），需要根据context_中的service_name和rpc_name去做反序列化成具体的请求对象
+
+private:
+  bool own_context_; // context_不在arena上，需要自己释放
 };
 
 } // namespace Protocol
\ No newline at end of file
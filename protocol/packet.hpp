@@ -1,19 +1,49 @@
 #pragma once
 
 #include "base.pb.h"
+#include "bufferpool.hpp"
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <utility>
 
 namespace Protocol {
+constexpr size_t PACKET_MAX_RETAIN_LEN = 1024 * 1024; // 缓冲区重新分配时最多保留的容量
+
+// 连续内存的缓冲区，内存从线程私有的缓冲区池中申请，扩容时不会对新空间做清零，已解析的空间通过摊还的方式压缩回收
 class Packet
 {
 public:
+  Packet() = default;
+  ~Packet() { BufferPool::Put( data_, cap_ ); }
+  Packet( const Packet& pkt ) { CopyFrom( pkt ); }
+  Packet( Packet&& pkt ) noexcept { swap( pkt ); }
+  Packet& operator=( const Packet& pkt )
+  {
+    if ( this != &pkt ) {
+      CopyFrom( pkt );
+    }
+    return *this;
+  }
+  Packet& operator=( Packet&& pkt ) noexcept
+  {
+    swap( pkt );
+    return *this;
+  }
+
   void Alloc( size_t len )
   {
-    data_.resize( len );
-    len_ = len;
+    // 处理大消息时扩容的空间超过了保留上限，则及时释放，避免长连接一直占用大块内存
+    if ( cap_ > max_retain_len_ && len <= max_retain_len_ ) {
+      BufferPool::Put( data_, cap_ );
+      data_ = nullptr;
+      cap_ = 0;
+    }
     use_len_ = 0;
     parse_len_ = 0;
+    reserve( len );
+    len_ = len;
   }
 
   void ReAlloc( size_t len )
@@ -22,31 +52,82 @@ public:
       return;
     }
 
-    data_.resize( len );
+    reserve( len );
     len_ = len;
   }
 
+  // 回收已经解析完的空间。只有待移动的数据不超过可回收的空间时才移动数据，这样移动的开销是摊还的
+  void Compact()
+  {
+    size_t needParseLen = NeedParseLen();
+    if ( 0 == needParseLen ) {
+      use_len_ = 0;
+      parse_len_ = 0;
+      return;
+    }
+    if ( parse_len_ < needParseLen ) {
+      return;
+    }
+    memmove( data_, DataParse(), needParseLen );
+    use_len_ = needParseLen;
+    parse_len_ = 0;
+  }
+
   void CopyFrom( const Packet& pkt )
   {
-    data_ = pkt.data_;
-    len_ = pkt.len_;
+    Alloc( pkt.len_ );
+    if ( pkt.use_len_ > 0 ) {
+      memcpy( data_, pkt.data_, pkt.use_len_ );
+    }
     use_len_ = pkt.use_len_;
     parse_len_ = pkt.parse_len_;
   }
 
-  uint8_t* Data() { return data_.data() + use_len_; }           // 缓冲区可以写入的开始地址
-  uint8_t* DataRaw() { return data_.data(); }                   // 原始缓冲区的开始地址
-  uint8_t* DataParse() { return data_.data() + parse_len_; }    // 需要解析的开始地址
+  void SetMaxRetainLen( size_t maxRetainLen ) { max_retain_len_ = maxRetainLen; }
+
+  uint8_t* Data() { return data_ + use_len_; }                  // 缓冲区可以写入的开始地址
+  uint8_t* DataRaw() { return data_; }                          // 原始缓冲区的开始地址
+  uint8_t* DataParse() { return data_ + parse_len_; }           // 需要解析的开始地址
   size_t NeedParseLen() const { return use_len_ - parse_len_; } // 还需要解析的长度
   size_t Len() const { return len_ - use_len_; }                // 缓存区中还可以写入的数据长度
   size_t UseLen() const { return use_len_; }                    // 缓冲区已经使用的容量
+  size_t ParseLen() const { return parse_len_; }                // 缓冲区已经完成解析的长度
   void UpdateUseLen( size_t add_len ) { use_len_ += add_len; }
   void UpdateParseLen( size_t add_len ) { parse_len_ += add_len; }
 
 private:
-  std::vector<uint8_t> data_; // 缓冲区
-  size_t len_ { 0 };          // 缓冲区的长度
-  size_t use_len_ { 0 };      // 缓冲区使用长度
-  size_t parse_len_ { 0 };    // 完成解析的长度
+  // 保证容量至少为len，已使用的数据会被保留，新分配的空间不做初始化
+  void reserve( size_t len )
+  {
+    if ( len <= cap_ ) {
+      return;
+    }
+
+    size_t cap = 0;
+    uint8_t* data = BufferPool::Get( std::max( len, cap_ * 2 ), cap ); // 按倍数扩容，摊还扩容的开销
+    if ( use_len_ > 0 ) {
+      memcpy( data, data_, use_len_ );
+    }
+    BufferPool::Put( data_, cap_ );
+    data_ = data;
+    cap_ = cap;
+  }
+
+  void swap( Packet& pkt ) noexcept
+  {
+    std::swap( data_, pkt.data_ );
+    std::swap( cap_, pkt.cap_ );
+    std::swap( len_, pkt.len_ );
+    std::swap( use_len_, pkt.use_len_ );
+    std::swap( parse_len_, pkt.parse_len_ );
+    std::swap( max_retain_len_, pkt.max_retain_len_ );
+  }
+
+  uint8_t* data_ { nullptr };                       // 缓冲区
+  size_t cap_ { 0 };                                // 缓冲区实际分配的容量
+  size_t len_ { 0 };                                // 缓冲区的长度
+  size_t use_len_ { 0 };                            // 缓冲区使用长度
+  size_t parse_len_ { 0 };                          // 完成解析的长度
+  size_t max_retain_len_ { PACKET_MAX_RETAIN_LEN }; // 缓冲区重新分配时最多保留的容量
 };
 } // namespace Protocol::Packet
\ No newline at end of file
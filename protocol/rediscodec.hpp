@@ -1,164 +1,334 @@
 #pragma once
 
+#include "bytescan.hpp"
 #include "codec.hpp"
 #include "redismessage.hpp"
-#include <cstdlib>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <initializer_list>
 #include <memory>
+#include <queue>
+#include <string_view>
+#include <vector>
 
 namespace Protocol {
-// 解析状态
-enum ReplyDecodeStatus
+constexpr uint32_t REDIS_READ_LEN = 4 * 1024;             // 每次至少可以读取的数据量，用于一次读取多个流水线应答
+constexpr int64_t REDIS_MAX_BULK_LEN = 512 * 1024 * 1024; // bulk string最大长度为512M
+constexpr int64_t REDIS_MAX_ELEMENTS = INT32_MAX;         // 聚合类型最多的元素个数
+constexpr size_t REDIS_MAX_DEPTH = 64;                    // 聚合类型最大的嵌套层数
+
+// 正在解析的聚合类型，还需要remaining_个元素才能完成
+struct RedisDecodeFrame
 {
-  FIRST_CHAR = 1,   // 第一个字符
-  SIMPLE_VALUE = 2, // reply单行值
-  BULK_VALUE = 3,   // 批量字符串值
-  END = 4,          // 完成了消息解析
+  RedisReply* reply_;
+  int64_t remaining_;
 };
 
-// 协议编解码
+/* 协议编解码，只用于客户端：编码命令，解码应答
+ * 流水线：EncodePipeline把N个命令打包成一次写入，Decode从字节流中按顺序解析出所有完整的应答，
+ * 通过GetMessage按发送命令的顺序依次取出
+ * 支持RESP2和RESP3的所有类型，聚合类型按树形结构解析，未完成的聚合类型保存在frames_中，
+ * 每次只消费完整的一行（bulk类型是长度行加上值），数据不完整时下次Decode从断点继续，不会重复解析已经完成的元素
+ * 属性（"|"）目前直接丢弃，不支持RESP3的流式字符串和流式聚合类型
+ */
 class RedisCodec : public Codec
 {
 public:
-  RedisCodec() { pkt_.Alloc( 100 ); }
-  ~RedisCodec() = default;
+  RedisCodec() { pkt_.Alloc( REDIS_READ_LEN ); }
+  ~RedisCodec() override = default;
+
+  CodecType Type() override { return RESP; }
 
-  CodecType Type() { return RESP; }
-  void* GetMessage()
+  // 一次Decode可能解析出多个应答，需要循环调用直到返回nullptr，应答按照接收的顺序返回
+  void* GetMessage() override
   {
-    if ( nullptr == message_ ) {
-      return nullptr;
-    }
-    if ( decode_status_ != END ) {
+    if ( replies_.empty() ) {
       return nullptr;
     }
+    RedisReply* reply = replies_.front().release();
+    replies_.pop();
+    return reply;
+  }
 
-    decode_status_ = FIRST_CHAR; // 消息被取出之后解析状态设置为FIRST_CHAR
-    return message_.release();
+  // msg为RedisCommand，直接编码到pkt中，pkt可以复用
+  bool Encode( void* msg, Packet& pkt ) override
+  {
+    const RedisCommand& command = *static_cast<RedisCommand*>( msg );
+    pkt.Alloc( command.OutLen() );
+    command.AppendOut( pkt );
+    return true;
   }
 
-private:
-  bool decodeFirstChar( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  // 不需要构造RedisCommand，参数直接从调用方的内存编码到pkt中，例如EncodeCommand( { "SET", key, value }, pkt )
+  bool EncodeCommand( std::initializer_list<std::string_view> args, Packet& pkt )
   {
-    if ( needDecodeLen < 1 ) {
-      decodeBreak = true;
-      return true;
+    if ( 0 == args.size() ) {
+      return false;
     }
+    pkt.Alloc( RespEncoder::CommandLen( args ) );
+    RespEncoder::AppendCommand( args, pkt );
+    return true;
+  }
 
-    char* curData = (char*)*data;
-    if ( *curData == '+' ) {
-      message_->type_ = SIMPLE_STRINGS;
-    } else if ( *curData == '-' ) {
-      message_->type_ = ERRORS;
-    } else if ( *curData == ':' ) {
-      message_->type_ = INTEGERS;
-    } else if ( *curData == '$' ) {
-      message_->type_ = BULK_STRINGS;
-    } else {
-      assert( 0 );
-    }
-
-    // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
-    needDecodeLen -= 1;
-    decodeLen += 1;
-    ( *data ) += 1;
-    if ( BULK_STRINGS == message_->type_ ) {
-      decode_status_ = BULK_VALUE;
-    } else {
-      decode_status_ = SIMPLE_VALUE;
+  // N个命令打包到一个缓冲区中，一次写入，对应的N个应答按顺序通过GetMessage取出
+  bool EncodePipeline( const RedisPipeline& pipeline, Packet& pkt )
+  {
+    if ( 0 == pipeline.Size() ) {
+      return false;
     }
+    pkt.Alloc( pipeline.OutLen() );
+    pipeline.AppendOut( pkt );
     return true;
   }
 
-  bool decodeSimpleValue( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  bool Decode( size_t len ) override
   {
-    char* curData = (char*)( *data );
-    bool getValue = false;
-    uint32_t currentDecodeLen = 0;
-    for ( uint32_t i = 0; i < needDecodeLen - 1; ++i ) {
-      if ( curData[i] == '\r' && curData[i + 1] == '\n' ) {
-        curData[i] = 0;
-        currentDecodeLen = i + 2;
-        message_->value_ = std::string( curData );
-        getValue = true;
+    pkt_.UpdateUseLen( len );
+    uint32_t decodeLen = 0;
+    uint32_t needDecodeLen = pkt_.NeedParseLen();
+    uint8_t* data = pkt_.DataParse();
+
+    // 只要还有未解析的网络字节流，就持续解析，一次读取到的多个完整应答都解析到就绪队列中
+    while ( true ) {
+      bool decodeBreak = false;
+      if ( nullptr == message_ ) {
+        message_ = std::make_unique<RedisReply>();
+      }
+      if ( !decodeValue( &data, needDecodeLen, decodeLen, decodeBreak ) ) {
+        return false;
+      }
+      if ( decodeBreak ) {
+        break;
+      }
+      if ( reply_finish_ ) { // 完成一个应答的解析，放入就绪队列，继续解析下一个应答
+        replies_.push( std::move( message_ ) );
+        reply_finish_ = false;
       }
     }
 
-    decodeBreak = true;
-    if ( !getValue ) {
-      pkt_.ReAlloc( pkt_.UseLen() * 2 ); // 无法完成value的解析，则尝试扩大下次读取的数据量
+    if ( decodeLen > 0 ) {
+      pkt_.UpdateParseLen( decodeLen );
+    }
+    // 保留未解析完的数据，回收已解析的空间，再保证缓冲区能容纳当前应答剩余的部分
+    pkt_.Compact();
+    if ( 0 == pkt_.UseLen() ) {
+      pkt_.Alloc( REDIS_READ_LEN ); // 没有待解析的数据，及时释放处理大应答时扩容的空间
+    }
+    // 单行的值不知道长度，每次至少能再读取REDIS_READ_LEN
+    pkt_.ReAlloc( std::max<size_t>( pkt_.ParseLen() + need_frame_len_, pkt_.UseLen() + REDIS_READ_LEN ) );
+    return true;
+  }
+
+private:
+  // 解析一个值的类型行，bulk类型还包括值本身，数据不完整时不消费任何数据
+  bool decodeValue( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  {
+    size_t lineEnd = ByteScan::FindCrlf( *data, needDecodeLen );
+    if ( lineEnd == needDecodeLen ) { // 还没有收到完整的一行
+      need_frame_len_ = 0;
+      decodeBreak = true;
       return true;
     }
+    if ( 0 == lineEnd ) { // 缺少类型字符
+      return false;
+    }
+    const char* curData = reinterpret_cast<const char*>( *data );
+    std::string_view line( curData + 1, lineEnd - 1 ); // 去掉类型字符
+    uint32_t currentDecodeLen = lineEnd + 2;
+    bool ok = true;
+    switch ( curData[0] ) {
+      case '+':
+        ok = decodeSimple( SIMPLE_STRINGS, line );
+        break;
+      case '-':
+        ok = decodeSimple( ERRORS, line );
+        break;
+      case ':':
+        ok = decodeSimple( INTEGERS, line );
+        break;
+      case '#':
+        ok = ( "t" == line || "f" == line ) && decodeSimple( BOOLEANS, line );
+        break;
+      case ',':
+        ok = decodeSimple( DOUBLES, line );
+        break;
+      case '(':
+        ok = decodeSimple( BIG_NUMBERS, line );
+        break;
+      case '_':
+        ok = line.empty() && decodeSimple( NULLS, line );
+        break;
+      case '$':
+        ok = decodeBulk( BULK_STRINGS, curData, needDecodeLen, line, currentDecodeLen, decodeBreak );
+        break;
+      case '!':
+        ok = decodeBulk( BULK_ERRORS, curData, needDecodeLen, line, currentDecodeLen, decodeBreak );
+        break;
+      case '=':
+        ok = decodeBulk( VERBATIM_STRINGS, curData, needDecodeLen, line, currentDecodeLen, decodeBreak );
+        break;
+      case '*':
+        ok = decodeAggregate( ARRAYS, line, 1 );
+        break;
+      case '~':
+        ok = decodeAggregate( SETS, line, 1 );
+        break;
+      case '>':
+        ok = decodeAggregate( PUSHES, line, 1 );
+        break;
+      case '%':
+        ok = decodeAggregate( MAPS, line, 2 );
+        break;
+      case '|':
+        ok = decodeAttribute( line );
+        break;
+      default:
+        ok = false; // 不支持的应答类型，字节流已经无法继续解析
+        break;
+    }
+    if ( !ok || decodeBreak ) {
+      return ok;
+    }
 
-    // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
+    // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置。
     needDecodeLen -= currentDecodeLen;
     decodeLen += currentDecodeLen;
     ( *data ) += currentDecodeLen;
-    decode_status_ = END;
-    assert( needDecodeLen == 0 );
+    need_frame_len_ = 0;
+    return true;
+  }
 
+  bool decodeSimple( RedisReplyType type, std::string_view line )
+  {
+    RedisReply& reply = newReply( type );
+    reply.value_.assign( line.data(), line.size() );
+    reply.is_null_ = NULLS == type;
+    finishValue();
     return true;
   }
 
-  bool decodeBulkValue( uint8_t** data, uint32_t& needDecodeLen, uint32_t& decodeLen, bool& decodeBreak )
+  // 长度行之后是长度字节的值和"\r\n"，长度为-1表示null值，值还没有接收完整时记录下还需要的长度用于扩容
+  bool decodeBulk( RedisReplyType type,
+                   const char* curData,
+                   uint32_t needDecodeLen,
+                   std::string_view line,
+                   uint32_t& currentDecodeLen,
+                   bool& decodeBreak )
   {
-    char* curData = (char*)( *data );
-    int32_t bulkLen = 0;
-    bool getBulkLen = false;
-    bool getBulkValue = false;
-    uint32_t currentDecodeLen = 0;
-    for ( uint32_t i = 0; i < needDecodeLen - 1; ++i ) {
-      if ( curData[i] != '\r' || curData[i + 1] != '\n' ) {
-        continue;
-      }
+    int64_t bulkLen = 0;
+    if ( !parseLen( line, bulkLen ) || bulkLen > REDIS_MAX_BULK_LEN ) {
+      return false;
+    }
+    if ( -1 == bulkLen ) {
+      newReply( type ).is_null_ = true;
+      finishValue();
+      return true;
+    }
+    const char* value = curData + currentDecodeLen;
+    currentDecodeLen += bulkLen + 2;
+    if ( needDecodeLen < currentDecodeLen ) {
+      need_frame_len_ = currentDecodeLen;
+      decodeBreak = true;
+      return true;
+    }
+    if ( curData[currentDecodeLen - 2] != '\r' || curData[currentDecodeLen - 1] != '\n' ) {
+      return false;
+    }
+    std::string_view str( value, bulkLen );
+    if ( VERBATIM_STRINGS == type && str.size() >= 4 && ':' == str[3] ) {
+      str.remove_prefix( 4 ); // 去掉"txt:"之类的格式前缀
+    }
+    newReply( type ).value_.assign( str.data(), str.size() );
+    finishValue();
+    return true;
+  }
 
-      // 还没解析到长度
-      if ( !getBulkLen ) {
-        getBulkLen = true;
-        curData[i] = 0;
-        bulkLen = std::atoi( curData );
-        // bulk string 最大长度为512M
-        if ( bulkLen > 512 * 1024 * 1024 ) {
-          return false;
-        }
-        curData[i] = '\r';     // 取完长度之后需要设置回去
-        if ( bulkLen == -1 ) { // null值
-          message_->is_null_ = true;
-          currentDecodeLen = i + 2;
-          getBulkValue = true;
-          break;
-        }
-      } else { // 解析到具体值（空值，或者非空值）
-        getBulkValue = true;
-        currentDecodeLen = i + 2;
-        if ( 0 == bulkLen ) { // 空值
-          message_->value_ = "";
-          break;
-        }
-        curData[i] = 0;                                              // 先设置字符串结束标志
-        message_->value_ = std::string( curData + ( i - bulkLen ) ); // 取字符串
-        curData[i] = '\r';                                           // 取完字符串之后需要设置回去
-        break;
-      }
+  // map的每个元素是一对key和value，所以实际的元素个数是count * multiple
+  bool decodeAggregate( RedisReplyType type, std::string_view line, int64_t multiple )
+  {
+    int64_t count = 0;
+    if ( !parseLen( line, count ) || count > REDIS_MAX_ELEMENTS ) {
+      return false;
+    }
+    RedisReply& reply = newReply( type );
+    if ( count <= 0 ) { // 空的聚合类型和null数组直接完成
+      reply.is_null_ = -1 == count;
+      finishValue();
+      return true;
+    }
+    if ( frames_.size() >= REDIS_MAX_DEPTH ) {
+      return false;
     }
+    frames_.push_back( { &reply, count * multiple } );
+    return true;
+  }
 
-    decodeBreak = true; // 不管是否能完成解析都跳出循环
-    if ( !getBulkValue ) {
-      pkt_.ReAlloc( pkt_.UseLen() * 2 ); // 无法完成value的解析，则尝试扩大下次读取的数据量
+  // 属性解析到单独的节点中，不计入父节点的元素个数，解析完成后丢弃，属性不能嵌套
+  bool decodeAttribute( std::string_view line )
+  {
+    int64_t count = 0;
+    if ( !parseLen( line, count ) || count < 0 || count > REDIS_MAX_ELEMENTS || in_attribute_ ) {
+      return false;
+    }
+    if ( 0 == count ) {
       return true;
     }
+    if ( frames_.size() >= REDIS_MAX_DEPTH ) {
+      return false;
+    }
+    attribute_ = RedisReply();
+    attribute_.type_ = MAPS;
+    in_attribute_ = true;
+    frames_.push_back( { &attribute_, count * 2 } );
+    return true;
+  }
 
-    // 更新剩余待解析数据长度，已经解析的长度，缓冲区指针的位置，当前解析的状态。
-    needDecodeLen -= currentDecodeLen;
-    decodeLen += currentDecodeLen;
-    ( *data ) += currentDecodeLen;
-    decode_status_ = END;
-    assert( needDecodeLen == 0 );
+  static bool parseLen( std::string_view line, int64_t& len )
+  {
+    auto result = std::from_chars( line.data(), line.data() + line.size(), len );
+    return result.ec == std::errc() && result.ptr == line.data() + line.size() && len >= -1;
+  }
 
-    return true;
+  // 新的值挂到正在解析的聚合类型下，没有聚合类型时就是应答本身
+  RedisReply& newReply( RedisReplyType type )
+  {
+    RedisReply* reply = message_.get();
+    if ( !frames_.empty() ) {
+      reply = &frames_.back().reply_->elements_.emplace_back();
+    }
+    reply->type_ = type;
+    return *reply;
+  }
+
+  /* 一个值完成解析，逐层更新聚合类型还需要的元素个数，最外层完成时整个应答完成
+   * 父节点的elements_只有在所有子聚合类型都完成之后才会追加元素，所以frames_中的指针一直有效
+   */
+  void finishValue()
+  {
+    while ( !frames_.empty() ) {
+      RedisDecodeFrame& frame = frames_.back();
+      if ( --frame.remaining_ > 0 ) {
+        return;
+      }
+      bool isAttribute = frame.reply_ == &attribute_;
+      frames_.pop_back();
+      if ( isAttribute ) {
+        in_attribute_ = false;
+        attribute_ = RedisReply();
+        return;
+      }
+    }
+    reply_finish_ = true;
   }
 
-  ReplyDecodeStatus decode_status_ { FIRST_CHAR };
   std::unique_ptr<RedisReply> message_ { nullptr };
+  std::queue<std::unique_ptr<RedisReply>> replies_; // 已经完成解析，等待取出的应答
+  std::vector<RedisDecodeFrame> frames_;           // 正在解析的聚合类型，从外到内
+  RedisReply attribute_;                            // 正在解析的属性
+  bool in_attribute_ { false };                     // 是否正在解析属性
+  bool reply_finish_ { false };                     // message_是否已经完成解析
+  size_t need_frame_len_ { 0 };                     // 当前未接收完整的bulk值从类型行开始还需要的长度
 };
 
 } // namespace Protocol
\ No newline at end of file
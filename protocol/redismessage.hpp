@@ -1,22 +1,100 @@
 #pragma once
 
-#include <sstream>
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "codec.hpp"
 
 namespace Protocol {
-// 只支持4种应答类型
+// RESP2和RESP3的应答类型
 enum RedisReplyType
 {
-  SIMPLE_STRINGS = 1, // 简单字符串，响应的首字节是 "+"，demo: "+OK\r\n"
-  ERRORS = 2,         // 错误，响应的首字节是 "-"，demo："-Error message\r\n"
-  INTEGERS = 3,       // 整型， 响应的首字节是 ":"，demo：":1000\r\n"
-  BULK_STRINGS = 4,   // 批量字符串，相应的首字节是 "$"，demo："$2\r\nok\r\n"，"$0\r\n\r\n"，"$-1\r\n"
+  SIMPLE_STRINGS = 1,    // 简单字符串，响应的首字节是 "+"，demo: "+OK\r\n"
+  ERRORS = 2,            // 错误，响应的首字节是 "-"，demo："-Error message\r\n"
+  INTEGERS = 3,          // 整型， 响应的首字节是 ":"，demo：":1000\r\n"
+  BULK_STRINGS = 4,      // 批量字符串，相应的首字节是 "$"，demo："$2\r\nok\r\n"，"$0\r\n\r\n"，"$-1\r\n"
+  ARRAYS = 5,            // 数组，首字节是 "*"，demo："*2\r\n:1\r\n:2\r\n"，"*-1\r\n"
+  NULLS = 6,             // RESP3的null，demo："_\r\n"
+  BOOLEANS = 7,          // RESP3的布尔值，demo："#t\r\n"
+  DOUBLES = 8,           // RESP3的浮点数，demo：",1.23\r\n"，",inf\r\n"
+  BIG_NUMBERS = 9,       // RESP3的大整数，value_中保存原始的十进制串，demo："(3492890328409238509324850943\r\n"
+  BULK_ERRORS = 10,      // RESP3的批量错误，demo："!21\r\nSYNTAX invalid syntax\r\n"
+  VERBATIM_STRINGS = 11, // RESP3的原样字符串，value_中去掉了"txt:"之类的格式前缀，demo："=15\r\ntxt:Some string\r\n"
+  MAPS = 12,             // RESP3的map，elements_中key和value交替存放，demo："%1\r\n+key\r\n:1\r\n"
+  SETS = 13,             // RESP3的集合，demo："~2\r\n+a\r\n+b\r\n"
+  PUSHES = 14,           // RESP3的推送（例如订阅的消息），和普通应答一样按接收顺序返回，demo：">1\r\n+hi\r\n"
 };
 
-/* 只支持5种命令
+// 命令的编码，先计算出精确的长度，一次扩容之后直接写入，不经过stringstream和中间的std::string
+class RespEncoder
+{
+public:
+  // "*N\r\n"，每个参数"$len\r\n参数\r\n"
+  template <typename Args>
+  static size_t CommandLen( const Args& args )
+  {
+    size_t len = headerLen( args.size() );
+    for ( const auto& arg : args ) {
+      len += headerLen( arg.size() ) + arg.size() + 2;
+    }
+    return len;
+  }
+
+  // out至少需要CommandLen个字节的空间，返回写入结束的位置
+  template <typename Args>
+  static char* WriteCommand( const Args& args, char* out )
+  {
+    out = writeHeader( '*', args.size(), out );
+    for ( const auto& arg : args ) {
+      out = writeHeader( '$', arg.size(), out );
+      if ( !arg.empty() ) {
+        memcpy( out, arg.data(), arg.size() );
+        out += arg.size();
+      }
+      *out++ = '\r';
+      *out++ = '\n';
+    }
+    return out;
+  }
+
+  // 追加到pkt已有的数据之后
+  template <typename Args>
+  static void AppendCommand( const Args& args, Packet& pkt )
+  {
+    size_t len = CommandLen( args );
+    pkt.ReAlloc( pkt.UseLen() + len );
+    WriteCommand( args, reinterpret_cast<char*>( pkt.Data() ) );
+    pkt.UpdateUseLen( len );
+  }
+
+private:
+  static size_t headerLen( size_t n )
+  {
+    size_t digits = 1;
+    for ( ; n >= 10; n /= 10 ) {
+      ++digits;
+    }
+    return 1 + digits + 2; // 类型字符，十进制长度，"\r\n"
+  }
+
+  static char* writeHeader( char type, size_t n, char* out )
+  {
+    *out++ = type;
+    out = std::to_chars( out, out + 20, n ).ptr; // size_t最多20位
+    *out++ = '\r';
+    *out++ = '\n';
+    return out;
+  }
+};
+
+/* 只支持5种命令，参数都会拷贝一份保存在params_中
+ * 不需要保存命令的场景可以直接使用RedisCodec::EncodeCommand( { "SET", key, value }, pkt )，参数不产生拷贝
   SET  // 设置key，value
   GET  // 获取key，对应的value值
   DEL  // 删除key
@@ -25,25 +103,25 @@ enum RedisReplyType
  */
 struct RedisCommand
 {
-  void makeGetCmd( std::string key )
+  void makeGetCmd( std::string_view key )
   {
     params_.emplace_back( "GET" );
     params_.emplace_back( key );
   }
 
-  void makeDelCmd( std::string key )
+  void makeDelCmd( std::string_view key )
   {
     params_.emplace_back( "DEL" );
     params_.emplace_back( key );
   }
 
-  void makeAuthCmd( std::string passwd )
+  void makeAuthCmd( std::string_view passwd )
   {
     params_.emplace_back( "AUTH" );
     params_.emplace_back( passwd );
   }
 
-  void makeSetCmd( std::string key, std::string value, int64_t expireTime = 0 )
+  void makeSetCmd( std::string_view key, std::string_view value, int64_t expireTime = 0 )
   {
     params_.emplace_back( "SET" );
     params_.emplace_back( key );
@@ -54,42 +132,104 @@ struct RedisCommand
     }
   }
 
-  void makeIncrCmd( const std::string& key )
+  void makeIncrCmd( std::string_view key )
   {
     params_.emplace_back( "INCR" );
-    params_.push_back( key );
+    params_.emplace_back( key );
   }
 
-  void GetOut( std::string& str )
+  size_t OutLen() const { return RespEncoder::CommandLen( params_ ); }
+
+  void GetOut( std::string& str ) const
   {
-    size_t len = params_.size();
-    std::stringstream out;
-    out << "*" << len << "\r\n";
-    for ( const auto& param : params_ ) {
-      out << "$" << param.size() << "\r\n";
-      out << param << "\r\n";
-    }
-    str = out.str();
+    str.clear();
+    AppendOut( str );
   }
 
+  // 编码结果追加到str之后，用于把多个命令打包到一起
+  void AppendOut( std::string& str ) const
+  {
+    size_t oldLen = str.size();
+    str.resize( oldLen + OutLen() );
+    RespEncoder::WriteCommand( params_, str.data() + oldLen );
+  }
+
+  // 编码结果追加到pkt已有的数据之后
+  void AppendOut( Packet& pkt ) const { RespEncoder::AppendCommand( params_, pkt ); }
+
   std::vector<std::string> params_;
 };
 
+// 流水线，多个命令一次发送，应答按照命令添加的顺序返回
+struct RedisPipeline
+{
+  RedisCommand& AddCommand()
+  {
+    commands_.emplace_back();
+    return commands_.back();
+  }
+  void AddCommand( RedisCommand command ) { commands_.push_back( std::move( command ) ); }
+  size_t Size() const { return commands_.size(); }
+  void Clear() { commands_.clear(); }
+
+  size_t OutLen() const
+  {
+    size_t len = 0;
+    for ( const auto& command : commands_ ) {
+      len += command.OutLen();
+    }
+    return len;
+  }
+
+  void GetOut( std::string& str ) const
+  {
+    str.clear();
+    str.reserve( OutLen() );
+    for ( const auto& command : commands_ ) {
+      command.AppendOut( str );
+    }
+  }
+
+  // 先按总长度扩容一次，所有命令直接写入pkt
+  void AppendOut( Packet& pkt ) const
+  {
+    pkt.ReAlloc( pkt.UseLen() + OutLen() );
+    for ( const auto& command : commands_ ) {
+      command.AppendOut( pkt );
+    }
+  }
+
+  std::vector<RedisCommand> commands_;
+};
+
+// 应答是一棵树，数组、map、集合和推送的元素保存在elements_中
 struct RedisReply
 {
   bool IsOk() const { return value_ == "OK"; }
-  bool IsError() const { return type_ == ERRORS; }
+  bool IsError() const { return type_ == ERRORS || type_ == BULK_ERRORS; }
   bool IsNull() const { return is_null_; }
+  bool IsPush() const { return type_ == PUSHES; }
   std::string Value() const { return value_; }
   int64_t IntValue() const
   {
     assert( type_ == INTEGERS );
     return std::stol( value_ );
   }
+  bool BoolValue() const
+  {
+    assert( type_ == BOOLEANS );
+    return value_ == "t";
+  }
+  double DoubleValue() const
+  {
+    assert( type_ == DOUBLES );
+    return std::strtod( value_.c_str(), nullptr ); // strtod可以解析"inf"、"-inf"和"nan"
+  }
 
   RedisReplyType type_;
   std::string value_;
   bool is_null_ { false };
+  std::vector<RedisReply> elements_; // 聚合类型的元素，map为key、value交替存放
 };
 
 } // namespace Protocol
\ No newline at end of file
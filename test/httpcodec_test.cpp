@@ -0,0 +1,192 @@
+// HttpCodec的回归测试，失败时assert退出
+// 编译：g++ -std=c++17 -I. -Iprotocol test/httpcodec_test.cpp protocol/base.pb.cc -lprotobuf -ljsoncpp -lpthread
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "protocol/httpcodec.hpp"
+
+using Protocol::HttpCodec;
+using Protocol::HttpMessage;
+
+namespace {
+// 把数据一次性交给codec解码，数据超过缓冲区剩余空间时分多次写入
+bool feed( HttpCodec& codec, std::string_view data )
+{
+  while ( !data.empty() ) {
+    size_t len = std::min( codec.Len(), data.size() );
+    memcpy( codec.Data(), data.data(), len );
+    if ( !codec.Decode( len ) ) {
+      return false;
+    }
+    data.remove_prefix( len );
+  }
+  return true;
+}
+
+std::unique_ptr<HttpMessage> next( HttpCodec& codec )
+{
+  return std::unique_ptr<HttpMessage>( static_cast<HttpMessage*>( codec.GetMessage() ) );
+}
+
+// 没有Content-Length也不是chunked编码的请求，body为空
+void testBodylessGet()
+{
+  HttpCodec codec;
+  assert( feed( codec, "GET /a HTTP/1.1\r\nHost: x\r\n\r\n" ) );
+  std::unique_ptr<HttpMessage> message = next( codec );
+  assert( message != nullptr );
+  assert( message->first_line_ == "GET /a HTTP/1.1" );
+  assert( message->GetHeader( "Host" ) == "x" );
+  assert( message->body_.empty() );
+  assert( nullptr == next( codec ) );
+}
+
+// chunk大小接近uint64_t的上限时，长度检查不能因为溢出而通过
+void testHugeChunkSize()
+{
+  // 已经缓存了2字节，2 + 0xfffffffffffffffe在uint64_t中回绕成0
+  HttpCodec codec;
+  assert( !feed( codec,
+                 "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nab\r\nfffffffffffffffe\r\nab" ) );
+
+  HttpCodec streaming;
+  streaming.SetChunkHandler( []( HttpMessage&, std::string_view, bool ) { return true; } );
+  assert( !feed( streaming, "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nfffffffffffffffe\r\nab" ) );
+}
+
+// 流式处理chunk时，对端每次都写满缓冲区，已经交给handler的数据被回收，缓冲区不会随上传的大小增长
+void testStreamingBufferBounded()
+{
+  constexpr int chunkCount = 64;
+  constexpr size_t chunkLen = 100003; // chunk的边界落在缓冲区的不同位置
+  char hex[16];
+  snprintf( hex, sizeof( hex ), "%zx", chunkLen );
+  std::string upload = "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  for ( int i = 0; i < chunkCount; ++i ) {
+    upload += hex + std::string( "\r\n" ) + std::string( chunkLen, 'a' + i % 26 ) + "\r\n";
+  }
+  upload += "0\r\n\r\n";
+
+  HttpCodec codec;
+  size_t received = 0;
+  bool end = false;
+  codec.SetChunkHandler( [&]( HttpMessage&, std::string_view data, bool last ) {
+    received += data.size();
+    end = last;
+    return true;
+  } );
+  size_t capacity = codec.Len();
+  std::string_view data = upload;
+  while ( !data.empty() ) {
+    size_t len = std::min( codec.Len(), data.size() );
+    memcpy( codec.Data(), data.data(), len );
+    assert( codec.Decode( len ) );
+    data.remove_prefix( len );
+    assert( codec.Len() <= capacity );
+  }
+  assert( received == chunkCount * chunkLen );
+  assert( end );
+  assert( next( codec ) != nullptr );
+}
+
+std::string encode( HttpCodec& codec, HttpMessage& message )
+{
+  Protocol::Packet pkt;
+  assert( codec.Encode( &message, pkt ) );
+  return std::string( reinterpret_cast<char*>( pkt.DataRaw() ), pkt.UseLen() );
+}
+
+// Content-Length和chunked编码不能同时出现，以最后一次设置的为准
+void testChunkedFraming()
+{
+  HttpCodec codec;
+  HttpMessage chunked;
+  chunked.SetStatusCode( Protocol::OK );
+  chunked.SetBody( "abc" );
+  chunked.SetChunked();
+  assert( encode( codec, chunked ) == "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                      "Transfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n" );
+
+  HttpMessage plain;
+  plain.SetStatusCode( Protocol::OK );
+  plain.SetChunked();
+  plain.SetBody( "abc" );
+  assert( encode( codec, plain ) == "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                    "Content-Length: 3\r\n\r\nabc" );
+}
+
+HttpMessage* response( uint64_t seq, std::string body )
+{
+  auto* message = new HttpMessage();
+  message->SetStatusCode( Protocol::OK );
+  message->SetBody( std::move( body ) );
+  message->seq_ = seq;
+  return message;
+}
+
+// 一次读取到多个流水线的GET请求，应答乱序编码之后仍然按请求的顺序发送
+void testPipelinedGet()
+{
+  constexpr int count = 8;
+  std::string requests;
+  for ( int i = 0; i < count; ++i ) {
+    requests += "GET /" + std::to_string( i ) + " HTTP/1.1\r\nHost: x\r\n\r\n";
+  }
+  HttpCodec codec;
+  assert( feed( codec, requests ) );
+
+  std::unique_ptr<HttpMessage> messages[count];
+  for ( int i = 0; i < count; ++i ) {
+    messages[i] = next( codec );
+    assert( messages[i] != nullptr );
+    assert( messages[i]->first_line_ == "GET /" + std::to_string( i ) + " HTTP/1.1" );
+    assert( messages[i]->seq_ == static_cast<uint64_t>( i + 1 ) );
+    // 每个消息只持有和自身长度相当的数据，不会持有后面所有的请求
+    assert( messages[i]->buf_.UseLen() <= 2 * ( requests.size() / count ) );
+  }
+  assert( nullptr == next( codec ) );
+
+  std::string out;
+  for ( int i = count - 1; i >= 0; --i ) {
+    std::unique_ptr<HttpMessage> message( response( messages[i]->seq_, std::to_string( i ) ) );
+    out += encode( codec, *message );
+  }
+  std::string expect;
+  for ( int i = 0; i < count; ++i ) {
+    expect += "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 1\r\n\r\n" + std::to_string( i );
+  }
+  assert( out == expect );
+}
+
+// 前面的请求一直没有应答时，缓存的应答个数有上限
+void testPendingResponsesLimit()
+{
+  HttpCodec codec;
+  codec.SetMaxPendingResponses( 2 );
+  Protocol::Packet pkt;
+  std::unique_ptr<HttpMessage> message( response( 2, "" ) );
+  assert( codec.Encode( message.get(), pkt ) && 0 == pkt.UseLen() );
+  message.reset( response( 3, "" ) );
+  assert( codec.Encode( message.get(), pkt ) && 0 == pkt.UseLen() );
+  message.reset( response( 4, "" ) );
+  assert( !codec.Encode( message.get(), pkt ) );
+  message.reset( response( 3, "" ) );
+  assert( !codec.Encode( message.get(), pkt ) ); // 重复的序号
+}
+} // namespace
+
+int main()
+{
+  testBodylessGet();
+  testHugeChunkSize();
+  testStreamingBufferBounded();
+  testChunkedFraming();
+  testPipelinedGet();
+  testPendingResponsesLimit();
+  printf( "httpcodec_test ok\n" );
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+// Logger异步模式的回归测试，失败时assert退出，运行前需要创建日志目录/home/backend/log/log_test/
+// 编译：g++ -std=c++17 -I. -o log_test test/log_test.cpp -lpthread
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "common/log.hpp"
+
+namespace {
+constexpr int ROUND_COUNT = 5;        // 创建线程的轮数
+constexpr int THREAD_COUNT = 20;      // 每轮创建的线程个数
+constexpr uint32_t FLUSH_MS = 20;     // 刷盘间隔
+constexpr int WAIT_RELEASE_MS = 2000; // 等待刷盘线程释放缓冲区的最长时间
+
+// 刷盘线程按间隔运行，等到缓冲区个数降到expect或者超时
+bool waitThreadBufferCount( size_t expect )
+{
+  for ( int waited = 0; waited < WAIT_RELEASE_MS; waited += FLUSH_MS ) {
+    if ( LOGGER.ThreadBufferCount() <= expect ) {
+      return true;
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds( FLUSH_MS ) );
+  }
+  return LOGGER.ThreadBufferCount() <= expect;
+}
+
+// 短生命周期的线程退出之后，它们的缓冲区要被释放，不能随线程个数一直增长
+void testExitedThreadBufferReleased()
+{
+  assert( !LOGGER.EnableAsync( 3000, FLUSH_MS ) );
+  assert( LOGGER.EnableAsync( 1 << 16, FLUSH_MS ) );
+  INFO( "main thread registers its buffer" );
+  assert( 1 == LOGGER.ThreadBufferCount() );
+  for ( int round = 0; round < ROUND_COUNT; ++round ) {
+    std::vector<std::thread> threads;
+    for ( int i = 0; i < THREAD_COUNT; ++i ) {
+      threads.emplace_back( [round, i]() { INFO( "round[%d] thread[%d] exits", round, i ); } );
+    }
+    for ( auto& thread : threads ) {
+      thread.join();
+    }
+    assert( waitThreadBufferCount( 1 ) );
+  }
+}
+} // namespace
+
+int main()
+{
+  testExitedThreadBufferReleased();
+  printf( "log_test ok\n" );
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+// Convert的性能测试，和直接调用protobuf、jsoncpp经过json串中转的写法对比，输出每次调用的耗时（微秒）
+// 用法：convertbench [循环次数]，默认100000次，消息为带8个TraceStack的Context
+// 编译：g++ -std=c++17 -O2 -I. -Iprotocol tools/convertbench.cpp protocol/base.pb.cc -o convertbench -lprotobuf -ljsoncpp
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "common/convert.hpp"
+#include "protocol/base.pb.h"
+
+namespace {
+using MySvr::Base::Context;
+
+constexpr int TRACE_STACK_COUNT = 8;       // 消息中的调用栈个数
+constexpr int DEFAULT_LOOP_COUNT = 100000; // 默认循环次数
+
+template <typename Func>
+double costUs( int loopCount, Func func )
+{
+  auto begin = std::chrono::steady_clock::now();
+  for ( int i = 0; i < loopCount; ++i ) {
+    func();
+  }
+  std::chrono::duration<double, std::micro> cost = std::chrono::steady_clock::now() - begin;
+  return cost.count() / loopCount;
+}
+
+void makeContext( Context& context )
+{
+  context.set_log_id( "d8kpt080bfg00000" );
+  context.set_service_name( "UserService" );
+  context.set_rpc_name( "GetUser" );
+  context.set_current_stack_id( TRACE_STACK_COUNT );
+  for ( int i = 0; i < TRACE_STACK_COUNT; ++i ) {
+    MySvr::Base::TraceStack* stack = context.add_trace_stack();
+    stack->set_parent_id( i );
+    stack->set_current_id( i + 1 );
+    stack->set_service_name( "Service" + std::to_string( i ) );
+    stack->set_rpc_name( "Rpc" );
+    stack->set_message( "success" );
+    stack->set_spend_us( 123456789012LL );
+    stack->set_is_batch( i % 2 );
+  }
+}
+
+// 每次调用都构造输出选项，Convert引入之前的写法
+bool textPb2JsonStr( const google::protobuf::Message& message, std::string& jsonStr )
+{
+  google::protobuf::util::JsonPrintOptions options;
+  options.always_print_primitive_fields = true;
+  options.preserve_proto_field_names = true;
+  options.always_print_enums_as_ints = true;
+  return google::protobuf::util::MessageToJsonString( message, &jsonStr, options ).ok();
+}
+
+bool textPb2Json( const google::protobuf::Message& message, Json::Value& value )
+{
+  std::string jsonStr;
+  if ( !textPb2JsonStr( message, jsonStr ) ) {
+    return false;
+  }
+  Json::CharReaderBuilder readerBuilder;
+  std::istringstream iss { jsonStr };
+  std::string errs;
+  return Json::parseFromStream( readerBuilder, iss, &value, &errs );
+}
+
+bool textJson2Pb( const Json::Value& value, google::protobuf::Message& message )
+{
+  Json::StreamWriterBuilder writerBuilder;
+  std::unique_ptr<Json::StreamWriter> writer { writerBuilder.newStreamWriter() };
+  std::ostringstream oss;
+  writer->write( value, &oss );
+  std::string jsonStr = oss.str();
+  return google::protobuf::util::JsonStringToMessage( jsonStr, &message ).ok();
+}
+
+void report( const char* name, double convertUs, double textUs )
+{
+  printf( "%-12s %10.2f %10.2f\n", name, convertUs, textUs );
+}
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  int loopCount = argc > 1 ? atoi( argv[1] ) : DEFAULT_LOOP_COUNT;
+  if ( loopCount <= 0 ) {
+    fprintf( stderr, "invalid loop count: %s\n", argv[1] );
+    return 1;
+  }
+
+  Context context;
+  makeContext( context );
+  Context parsed;
+  std::string jsonStr;
+  Json::Value value;
+  if ( !Common::Convert::Pb2JsonStr( context, jsonStr ) || !Common::Convert::Pb2Json( context, value ) ) {
+    fprintf( stderr, "convert failed\n" );
+    return 1;
+  }
+
+  printf( "%-12s %10s %10s\n", "us/call", "Convert", "text" );
+  std::string out;
+  report( "Pb2JsonStr",
+          costUs( loopCount, [&]() { Common::Convert::Pb2JsonStr( context, out ); } ),
+          costUs( loopCount, [&]() {
+            out.clear();
+            textPb2JsonStr( context, out );
+          } ) );
+  report( "JsonStr2Pb",
+          costUs( loopCount, [&]() { Common::Convert::JsonStr2Pb( jsonStr, parsed ); } ),
+          costUs( loopCount, [&]() { google::protobuf::util::JsonStringToMessage( jsonStr, &parsed ); } ) );
+  Json::Value outValue;
+  report( "Pb2Json",
+          costUs( loopCount, [&]() { Common::Convert::Pb2Json( context, outValue ); } ),
+          costUs( loopCount, [&]() { textPb2Json( context, outValue ); } ) );
+  report( "Json2Pb",
+          costUs( loopCount, [&]() { Common::Convert::Json2Pb( value, parsed ); } ),
+          costUs( loopCount, [&]() { textJson2Pb( value, parsed ); } ) );
+  return 0;
+}
\ No newline at end of file
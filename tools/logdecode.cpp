@@ -0,0 +1,296 @@
+// 把Logger::EnableBinary写出的二进制日志还原成文本日志，输出格式和文本模式一致
+// 用法：logdecode xxx.binlog > xxx.log，不指定文件时从标准输入读取
+#include <time.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common/log.hpp"
+
+namespace {
+using Common::LogBinary;
+using Common::LogBinaryHeader;
+
+struct Site
+{
+  uint8_t level_;
+  uint32_t line_;
+  bool has_cid_;
+  std::vector<uint8_t> types_;
+  std::string file_;
+  std::string function_;
+  std::string format_;
+};
+
+std::map<std::pair<uint32_t, uint32_t>, Site> sites_; // 按(pid, 位置编号)索引的位置定义
+
+template <typename... Args>
+void appendFormat( std::string& out, const char* format, Args... args )
+{
+  int len = snprintf( nullptr, 0, format, args... );
+  if ( len <= 0 ) {
+    return;
+  }
+  size_t oldLen = out.size();
+  out.resize( oldLen + len + 1 );
+  snprintf( out.data() + oldLen, len + 1, format, args... );
+  out.resize( oldLen + len );
+}
+
+void appendLinePrefix( std::string& out, uint8_t level, const LogBinaryHeader& header, std::string_view logId )
+{
+  char timeStr[32] { 0 };
+  time_t sec = header.time_us_ / 1'000'000;
+  struct tm tmTime;
+  strftime( timeStr, sizeof( timeStr ), "%F %T", localtime_r( &sec, &tmTime ) );
+  out.append( Common::LogLevelStr( static_cast<Common::LogLevel>( level ) ) ).append( " " ).append( timeStr );
+  appendFormat( out, ":%06ld %u,", static_cast<long>( header.time_us_ % 1'000'000 ), header.pid_ );
+  out.append( logId ).append( " " );
+}
+
+bool readLogId( const char*& data, size_t& len, std::string_view& logId )
+{
+  uint8_t logIdLen = 0;
+  if ( !LogBinary::ReadRaw( data, len, logIdLen ) || len < logIdLen ) {
+    return false;
+  }
+  logId = std::string_view( data, logIdLen );
+  data += logIdLen;
+  len -= logIdLen;
+  return true;
+}
+
+bool defineSite( const LogBinaryHeader& header, const char* data, size_t len )
+{
+  uint32_t siteId = 0;
+  uint8_t hasCid = 0;
+  uint8_t argCnt = 0;
+  Site site;
+  if ( !LogBinary::ReadRaw( data, len, siteId ) || !LogBinary::ReadRaw( data, len, site.level_ )
+       || !LogBinary::ReadRaw( data, len, site.line_ ) || !LogBinary::ReadRaw( data, len, hasCid )
+       || !LogBinary::ReadRaw( data, len, argCnt ) || len < argCnt ) {
+    return false;
+  }
+  site.has_cid_ = hasCid != 0;
+  site.types_.assign( data, data + argCnt );
+  data += argCnt;
+  len -= argCnt;
+  std::string_view file;
+  std::string_view function;
+  std::string_view format;
+  if ( !LogBinary::ReadString( data, len, file ) || !LogBinary::ReadString( data, len, function )
+       || !LogBinary::ReadString( data, len, format ) ) {
+    return false;
+  }
+  site.file_ = file;
+  site.function_ = function;
+  site.format_ = format;
+  sites_[{ header.pid_, siteId }] = std::move( site );
+  return true;
+}
+
+bool decodeText( const LogBinaryHeader& header, const char* data, size_t len, std::string& out )
+{
+  std::string_view logId;
+  uint8_t level = 0;
+  std::string_view text;
+  if ( !readLogId( data, len, logId ) || !LogBinary::ReadRaw( data, len, level )
+       || !LogBinary::ReadString( data, len, text ) ) {
+    return false;
+  }
+  appendLinePrefix( out, level, header, logId );
+  out.append( text ).append( "\n" );
+  return true;
+}
+
+/* 按格式串中的转换说明依次取出参数，每个转换说明去掉长度修饰之后，按参数实际保存的类型重新拼出只有一个参数的格式串
+ * 宽度和精度为*时同样从参数中读取
+ */
+bool formatMessage( const Site& site, const char* data, size_t len, std::string& out )
+{
+  const std::string& format = site.format_;
+  size_t argIndex = 0;
+  auto nextArg = [&]( uint8_t& type ) {
+    if ( argIndex >= site.types_.size() ) {
+      return false;
+    }
+    type = site.types_[argIndex++];
+    return true;
+  };
+  auto readInt = [&]( int64_t& value ) {
+    uint8_t type = 0;
+    return nextArg( type ) && type != Common::LOG_ARG_STRING && LogBinary::ReadRaw( data, len, value );
+  };
+
+  for ( size_t i = 0; i < format.size(); ++i ) {
+    if ( format[i] != '%' ) {
+      out.push_back( format[i] );
+      continue;
+    }
+    if ( ++i < format.size() && '%' == format[i] ) {
+      out.push_back( '%' );
+      continue;
+    }
+    std::string spec = "%";
+    while ( i < format.size() && format[i] != '\0' && strchr( "-+ #0'", format[i] ) != nullptr ) {
+      spec.push_back( format[i++] );
+    }
+    for ( bool precision = false;; precision = true ) { // 先处理宽度，再处理精度
+      if ( i < format.size() && '*' == format[i] ) {
+        int64_t value = 0;
+        if ( !readInt( value ) ) {
+          return false;
+        }
+        spec.append( std::to_string( value ) );
+        ++i;
+      }
+      while ( i < format.size() && isdigit( format[i] ) ) {
+        spec.push_back( format[i++] );
+      }
+      if ( precision || i >= format.size() || format[i] != '.' ) {
+        break;
+      }
+      spec.push_back( format[i++] );
+    }
+    size_t shortLen = 0; // h和hh需要按short和char截断
+    while ( i < format.size() && format[i] != '\0' && strchr( "hlLqjzt", format[i] ) != nullptr ) {
+      shortLen = 'h' == format[i] ? shortLen + 1 : 0;
+      ++i;
+    }
+    if ( i >= format.size() ) {
+      return false;
+    }
+
+    char conversion = format[i];
+    if ( 'n' == conversion ) {
+      continue;
+    }
+    uint8_t type = 0;
+    if ( !nextArg( type ) ) {
+      return false;
+    }
+    if ( Common::LOG_ARG_STRING == type ) {
+      std::string_view str;
+      if ( !LogBinary::ReadString( data, len, str ) ) {
+        return false;
+      }
+      if ( 's' == conversion ) {
+        appendFormat( out, ( spec + "s" ).c_str(), std::string( str ).c_str() );
+      } else {
+        out.append( str ); // 字符串用了非%s的转换说明，原样输出内容
+      }
+      continue;
+    }
+
+    uint64_t raw = 0;
+    if ( !LogBinary::ReadRaw( data, len, raw ) ) {
+      return false;
+    }
+    int64_t intValue = static_cast<int64_t>( raw );
+    double doubleValue = 0;
+    memcpy( &doubleValue, &raw, sizeof( doubleValue ) );
+    if ( Common::LOG_ARG_DOUBLE == type ) {
+      intValue = static_cast<int64_t>( doubleValue );
+    } else {
+      doubleValue = static_cast<double>( intValue );
+    }
+
+    bool isSigned = strchr( "di", conversion ) != nullptr;
+    if ( 1 == shortLen ) {
+      intValue = isSigned ? int64_t( int16_t( intValue ) ) : int64_t( uint16_t( intValue ) );
+    } else if ( 2 == shortLen ) {
+      intValue = isSigned ? int64_t( int8_t( intValue ) ) : int64_t( uint8_t( intValue ) );
+    }
+
+    if ( isSigned ) {
+      appendFormat( out, ( spec + "lld" ).c_str(), static_cast<long long>( intValue ) );
+    } else if ( strchr( "ouxX", conversion ) != nullptr ) {
+      appendFormat( out, ( spec + "ll" + conversion ).c_str(), static_cast<unsigned long long>( intValue ) );
+    } else if ( 'c' == conversion ) {
+      appendFormat( out, ( spec + "c" ).c_str(), static_cast<int>( intValue ) );
+    } else if ( strchr( "eEfFgGaA", conversion ) != nullptr ) {
+      appendFormat( out, ( spec + conversion ).c_str(), doubleValue );
+    } else if ( 'p' == conversion ) {
+      appendFormat( out, ( spec + "p" ).c_str(), reinterpret_cast<void*>( raw ) );
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool decodeLog( const LogBinaryHeader& header, const char* data, size_t len, std::string& out )
+{
+  auto iter = sites_.find( { header.pid_, header.site_id_ } );
+  if ( iter == sites_.end() ) {
+    return false;
+  }
+  const Site& site = iter->second;
+  std::string_view logId;
+  if ( !readLogId( data, len, logId ) ) {
+    return false;
+  }
+  appendLinePrefix( out, site.level_, header, logId );
+  if ( site.has_cid_ ) {
+    appendFormat( out, "(%d:%s:%s:%u):", header.cid_, site.file_.c_str(), site.function_.c_str(), site.line_ );
+  } else {
+    appendFormat( out, "(%s:%s:%u):", site.file_.c_str(), site.function_.c_str(), site.line_ );
+  }
+  if ( !formatMessage( site, data, len, out ) ) {
+    return false;
+  }
+  out.append( "\n" );
+  return true;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  FILE* file = argc > 1 ? fopen( argv[1], "rb" ) : stdin;
+  if ( nullptr == file ) {
+    fprintf( stderr, "open %s failed: %s\n", argv[1], strerror( errno ) );
+    return 1;
+  }
+
+  LogBinaryHeader header;
+  std::string record;
+  std::string out;
+  uint64_t offset = 0;
+  while ( fread( &header, sizeof( header ), 1, file ) == 1 ) {
+    if ( header.len_ < sizeof( header ) ) {
+      fprintf( stderr, "invalid record len[%u] at offset[%lu]\n", header.len_, offset );
+      return 1;
+    }
+    record.resize( header.len_ - sizeof( header ) );
+    if ( fread( record.data(), 1, record.size(), file ) != record.size() ) {
+      fprintf( stderr, "truncated record at offset[%lu]\n", offset );
+      return 1;
+    }
+
+    out.clear();
+    bool ok = false;
+    if ( Common::LOG_BINARY_SITE_DEFINE == header.site_id_ ) {
+      ok = defineSite( header, record.data(), record.size() );
+    } else if ( Common::LOG_BINARY_TEXT == header.site_id_ ) {
+      ok = decodeText( header, record.data(), record.size(), out );
+    } else {
+      ok = decodeLog( header, record.data(), record.size(), out );
+    }
+    if ( ok ) {
+      fwrite( out.data(), 1, out.size(), stdout );
+    } else { // 单条记录解析失败不影响后面的记录
+      fprintf( stderr, "decode record failed at offset[%lu], site[%u]\n", offset, header.site_id_ );
+    }
+    offset += header.len_;
+  }
+  return 0;
+}
\ No newline at end of file